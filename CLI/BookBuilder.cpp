@@ -0,0 +1,42 @@
+#include <iostream>
+#include <string>
+#include "WorldStateFactory.h"
+#include "FMultiAgentMCTS.h"
+
+// Plays the demo map with deep searches and stores the root statistics of every position in
+// an opening book that the planner seeds its trees from.
+// Usage: HysteriaBookBuilder [output=opening.book] [turns=40] [rollouts=20000]
+int main(int argc, char** argv)
+{
+    using namespace HysteriaSim;
+
+    const std::string output = argc > 1 ? argv[1] : "opening.book";
+    const int turns = argc > 2 ? std::stoi(argv[2]) : 40;
+    const int rollouts = argc > 3 ? std::stoi(argv[3]) : 20000;
+    const int agents = 3;
+
+    // Extend an existing book instead of starting over
+    FOpeningBook<16, 16, agents> book;
+    if (book.Load(output))
+        std::cout << "Extending " << output << " (" << book.Num() << " positions)\n";
+
+    FMultiAgentMCTS<16, 16, agents> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(rollouts);
+    planner.SetOpeningBookRecorder(&book);
+
+    const double start = HysteriaNowSeconds();
+    for (int turn = 0; turn < turns; ++turn)
+    {
+        planner.Step();
+        std::cout << "Turn " << turn + 1 << "/" << turns << ", " << book.Num() << " positions, "
+                  << int(HysteriaNowSeconds() - start) << "s\n";
+    }
+
+    if (!book.Save(output))
+    {
+        std::cerr << "Could not write " << output << "\n";
+        return 1;
+    }
+    std::cout << "Saved " << book.Num() << " positions to " << output << "\n";
+    return 0;
+}
@@ -0,0 +1,581 @@
+#include <iostream>
+#include <vector>
+#include "WorldStateFactory.h"
+#include "FMultiAgentMCTS.h"
+#include "GridView.h"
+
+// Headless checks of the engine-free core. Run by ctest; exits non-zero if any check fails.
+
+static int Failures = 0;
+
+#define CHECK(Cond) \
+    do { \
+        if (!(Cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #Cond "\n"; \
+            ++Failures; \
+        } \
+    } while (0)
+
+using FView = FGridView<8, 8, 2>;
+using FSmallWorld = WorldState<8, 8, 2>;
+
+static bool IsOp(const FGridViewOp& Op, EGridViewOpType Type, EGridVisual Visual, int Instance)
+{
+    return Op.Type == Type && Op.Visual == Visual && Op.Instance == Instance;
+}
+
+static FWorldChangeSet CellChange(int X, int Y, CellType Tile, ItemType Item)
+{
+    FWorldChangeSet changes;
+    changes.AddCell(X, Y, Tile, Item);
+    return changes;
+}
+
+static bool HasCell(const FWorldChangeSet& Changes, int X, int Y)
+{
+    for (const FCellChange& cell : Changes.Cells)
+        if (cell.X == X && cell.Y == Y) return true;
+    return false;
+}
+
+static bool HasAgent(const FWorldChangeSet& Changes, int Agent)
+{
+    for (const FAgentChange& agent : Changes.Agents)
+        if (agent.Agent == Agent) return true;
+    return false;
+}
+
+static void TestChangeSetTracksWrites()
+{
+    FSmallWorld world;
+    world.agents[0] = AgentState{1, 1, false, ItemType::None, 0, false};
+    world.agents[1] = AgentState{5, 5, false, ItemType::None, 0, false};
+    world.ClearChanges();
+    CHECK(!world.HasChanges());
+
+    world.SetTile(2, 3, CellType::Fire);
+    world.SetItem(1, 2, ItemType::Coin);
+    world.ApplyAgentAction(0, FAgentAction(EActionType::MoveDown));
+    FWorldChangeSet changes;
+    world.GetChanges(changes);
+    CHECK(changes.Cells.size() == 2);
+    CHECK(HasCell(changes, 2, 3) && HasCell(changes, 1, 2));
+    CHECK(changes.Agents.size() == 1 && HasAgent(changes, 0));
+    CHECK(changes.Agents[0].State.y == 2);
+
+    // Picking up the coin changes the cell and the agent
+    world.ClearChanges();
+    world.ApplyAgentAction(0, FAgentAction(EActionType::Pickup));
+    changes.Reset();
+    world.GetChanges(changes);
+    CHECK(changes.Cells.size() == 1 && HasCell(changes, 1, 2));
+    CHECK(changes.Cells[0].Item == ItemType::None);
+    CHECK(HasAgent(changes, 0));
+
+    // A blocked move and a wait change nothing
+    world.ClearChanges();
+    world.SetTile(5, 4, CellType::Wall);
+    world.ClearChanges();
+    world.ApplyAgentAction(1, FAgentAction(EActionType::MoveUp));
+    world.ApplyAgentAction(1, FAgentAction(EActionType::Wait));
+    CHECK(!world.HasChanges());
+}
+
+static void TestDiffIsExact()
+{
+    FSmallWorld before;
+    FSmallWorld after = before;
+    after.SetTile(7, 0, CellType::Wall);
+    after.SetItem(3, 3, ItemType::Food);
+    after.SetItem(3, 3, ItemType::None); // written back: dirty, but not different
+    after.agents[1].score = 10;
+
+    FWorldChangeSet diff;
+    before.DiffTo(after, diff);
+    CHECK(diff.Cells.size() == 1 && HasCell(diff, 7, 0));
+    CHECK(diff.Agents.size() == 1 && HasAgent(diff, 1));
+
+    FWorldChangeSet dirty;
+    after.GetChanges(dirty);
+    CHECK(HasCell(dirty, 3, 3));
+}
+
+// Every version's change set must list at least what really changed since the version before
+static void TestSnapshotChangesCoverDiff()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(100);
+
+    auto previous = planner.GetWorldSnapshot();
+    CHECK(previous->Changes.Cells.size() == 16 * 16);
+    CHECK(previous->Changes.Agents.size() == 3);
+
+    for (int turn = 0; turn < 20; ++turn)
+    {
+        if (turn % 3 == 0)
+        {
+            planner.QueueWorldEdit(FWorldEdit::SetItem(turn % 16, 5, ItemType::Coin));
+            planner.QueueWorldEdit(FWorldEdit::MoveAgent(turn % 3, 8, 8));
+            planner.ApplyQueuedEdits();
+        }
+        else
+        {
+            planner.Step();
+        }
+
+        auto snapshot = planner.GetWorldSnapshot();
+        CHECK(snapshot->Version == previous->Version + 1);
+        FWorldChangeSet diff;
+        previous->State.DiffTo(snapshot->State, diff);
+        for (const FCellChange& cell : diff.Cells)
+            CHECK(HasCell(snapshot->Changes, cell.X, cell.Y));
+        for (const FAgentChange& agent : diff.Agents)
+            CHECK(HasAgent(snapshot->Changes, agent.Agent));
+        previous = snapshot;
+    }
+}
+
+// An edit in the middle of a time-sliced turn that rebuilds a tree gives it its full rollout
+// budget again, instead of counting the discarded tree's rollouts towards it
+static void TestMidTurnEditRestartsRolloutBudget()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(200);
+
+    planner.BeginTurn();
+    planner.AdvanceTurn(300);
+    const std::array<int, 3> before = planner.GetLastStepStats().RolloutsPerAgent;
+    CHECK(before[0] > 0);
+
+    // An item under agent 0 changes its legal moves: its tree is rebuilt
+    const AgentState& agent = planner.GetWorldSnapshot()->State.agents[0];
+    planner.QueueWorldEdit(FWorldEdit::SetItem(agent.x, agent.y, ItemType::Coin));
+    while (!planner.AdvanceTurn(100)) {}
+    CHECK(planner.GetLastEditInvalidation()[0] == ETreeInvalidation::Rebuilt);
+
+    const FPlannerStepStats<3>& stats = planner.GetLastStepStats();
+    // Every searched tree ends with its full share; the discarded rollouts still count in the total
+    int expectedTotal = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!planner.GetSearchedAgents()[i]) continue;
+        CHECK(stats.RolloutsPerAgent[i] == 200);
+        expectedTotal += stats.RolloutsPerAgent[i];
+        if (planner.GetLastEditInvalidation()[i] != ETreeInvalidation::Kept)
+            expectedTotal += before[i];
+    }
+    CHECK(stats.TotalRollouts == expectedTotal);
+    planner.CommitTurn();
+}
+
+// Joint search keeps the agent budget: only the selected agents' trees are searched
+static void TestJointSearchHonoursAgentBudget()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetJointSearch(true);
+    planner.SetSearchAgentBudget(1);
+    planner.SetRolloutsPerAgent(200);
+
+    for (int turn = 0; turn < 3; ++turn)
+    {
+        planner.Step();
+        const auto& stats = planner.GetLastStepStats();
+        CHECK(stats.TotalRollouts == 200);
+        int searched = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (planner.GetSearchedAgents()[i])
+            {
+                ++searched;
+                CHECK(stats.TreeMemory[i].Nodes > 1);
+                CHECK(stats.RolloutsPerAgent[i] == 200);
+            }
+            else
+            {
+                CHECK(stats.TreeMemory[i].Nodes == 1);
+            }
+        }
+        CHECK(searched == 1);
+    }
+}
+
+// Time-sliced joint turns count the rollouts they actually ran and stop on CancelSearch
+static void TestJointSliceCountsAndCancels()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetJointSearch(true);
+    planner.SetRolloutsPerAgent(200);
+
+    planner.BeginTurn();
+    CHECK(!planner.AdvanceTurn(50));
+    CHECK(planner.GetLastStepStats().TotalRollouts == 50);
+    for (int i = 0; i < 3; ++i)
+        CHECK(planner.GetLastStepStats().RolloutsPerAgent[i] == 50);
+
+    planner.CancelSearch();
+    CHECK(planner.AdvanceTurn(50));
+    CHECK(planner.GetLastStepStats().TotalRollouts == 50);
+    planner.CommitTurn();
+
+    // The next turn searches in full again
+    planner.BeginTurn();
+    while (!planner.AdvanceTurn(64)) {}
+    CHECK(planner.GetLastStepStats().TotalRollouts == 200);
+    planner.CommitTurn();
+}
+
+// Records how the parallel search hands leaves to EvaluateBatch
+struct FCountingEvaluator : FRandomPlayoutEvaluator<16, 16, 3>
+{
+    static std::atomic<int> Leaves;
+    static std::atomic<int> LargestBatch;
+
+    void EvaluateBatch(const FWorldState* States, FSimScratch* Scratches, int Count, int Agent,
+                       const FSimContext& SimContext, double* OutValues) const
+    {
+        Leaves += Count;
+        int largest = LargestBatch.load();
+        while (Count > largest && !LargestBatch.compare_exchange_weak(largest, Count)) {}
+        FRandomPlayoutEvaluator<16, 16, 3>::EvaluateBatch(States, Scratches, Count, Agent, SimContext, OutValues);
+    }
+};
+std::atomic<int> FCountingEvaluator::Leaves{0};
+std::atomic<int> FCountingEvaluator::LargestBatch{0};
+
+static void TestParallelSearchBatchesLeaves()
+{
+    using namespace HysteriaSim;
+    using FTree = FMCTS<16, 16, 3, FCountingEvaluator>;
+    FTree tree(CreateDemoMap(), 0);
+    const FSimulationContext<16, 16, 3> context;
+
+    // Without a leaf cache every rollout's leaf goes through a batch
+    CHECK(tree.RunSearch(2, 301, context) == 301);
+    CHECK(FCountingEvaluator::Leaves == 301);
+    CHECK(FCountingEvaluator::LargestBatch > 1);
+    CHECK(FCountingEvaluator::LargestBatch <= FTree::LeafBatchSize);
+}
+
+// The planner repairs its distance fields from each published change set; they must match
+// fields built from scratch for the same world
+static void TestDistanceFieldsFollowPlanner()
+{
+    using namespace HysteriaSim;
+    using FFields = FDistanceFieldCache<16, 16>;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(50);
+
+    for (int turn = 0; turn < 12; ++turn)
+    {
+        if (turn % 2 == 0)
+        {
+            const FWorldEdit edits[] = {
+                FWorldEdit::SetTile(turn, 6, turn % 4 == 0 ? CellType::Wall : CellType::Fire),
+                FWorldEdit::SetItem(15 - turn, 9, ItemType::Coin),
+                FWorldEdit::SetItem(3, turn, ItemType::Hose),
+            };
+            planner.ApplyWorldEdits(edits, 3);
+        }
+        planner.Step();
+
+        FFields fresh;
+        const auto& state = planner.GetWorldSnapshot()->State;
+        fresh.Rebuild(state.grid, state.items);
+        int mismatches = 0;
+        for (int t = 0; t < FFields::NumTargets; ++t)
+            for (int y = 0; y < 16; ++y)
+                for (int x = 0; x < 16; ++x)
+                    mismatches += planner.GetDistanceFields().GetDistance(static_cast<EDistanceTarget>(t), x, y) !=
+                                  fresh.GetDistance(static_cast<EDistanceTarget>(t), x, y);
+        CHECK(mismatches == 0);
+    }
+}
+
+// The evaluator reads the root's distance fields only at leaves whose tiles and items still
+// match the root; a coin picked up on the way must not count as near
+static void TestLinearEvaluatorIgnoresStaleFields()
+{
+    using FEvaluator = FStaticLeafEvaluator<8, 8, 2>;
+    FSmallWorld root;
+    root.SetItem(2, 1, ItemType::Coin);
+    root.SetItem(6, 6, ItemType::Coin);
+    root.agents[0] = AgentState{1, 1, false, ItemType::None, 0, false};
+    root.agents[1] = AgentState{7, 0, false, ItemType::None, 0, false};
+    root.ClearChanges();
+
+    FDistanceFieldCache<8, 8> fields;
+    fields.Rebuild(root.grid, root.items);
+    FSimulationContext<8, 8, 2> withFields;
+    withFields.PublishDistanceFields(fields);
+    const FSimulationContext<8, 8, 2> withoutFields;
+    const FEvaluator evaluator;
+    FSimulationScratch<2> scratch;
+
+    // Only the agent moved: the fields still hold and agree with a BFS
+    FSmallWorld moved = root.Clone();
+    moved.ApplyAgentAction(0, FAgentAction(EActionType::MoveRight));
+    CHECK(!moved.HasCellChanges());
+    CHECK(evaluator.Evaluate(moved, 0, withFields, scratch) == evaluator.Evaluate(moved, 0, withoutFields, scratch));
+
+    // The coin under the agent is gone; the root's fields would still put it at distance 0
+    FSmallWorld collected = moved.Clone();
+    collected.ApplyAgentAction(0, FAgentAction(EActionType::Pickup));
+    CHECK(collected.HasCellChanges());
+    CHECK(evaluator.Evaluate(collected, 0, withFields, scratch) == evaluator.Evaluate(collected, 0, withoutFields, scratch));
+    CHECK(evaluator.EvaluateJoint(collected, withFields, scratch) == evaluator.EvaluateJoint(collected, withoutFields, scratch));
+}
+
+// An 8x8 two-agent world as WorldState::Save writes it: 64 tile bytes, 64 item bytes, then per
+// agent x, y, hasItem, item (one byte each), score (4 bytes), isPanicking, then the turn counter
+static std::vector<uint8_t> SavedSmallWorld()
+{
+    FSmallWorld world;
+    world.agents[0].x = 1;
+    world.agents[0].y = 2;
+    world.agents[1].x = 2;
+    world.agents[1].y = 2;
+    FBinaryWriter writer;
+    world.Save(writer);
+    return writer.GetBytes();
+}
+
+static bool LoadSmallWorld(const std::vector<uint8_t>& Bytes)
+{
+    FSmallWorld world;
+    FBinaryReader reader(Bytes.data(), Bytes.size());
+    return world.Load(reader);
+}
+
+static void TestLoadRejectsCorruptWorlds()
+{
+    const size_t agentsStart = 8 * 8 * 2;
+    std::vector<uint8_t> bytes = SavedSmallWorld();
+    CHECK(bytes.size() == agentsStart + 2 * 9 + 1);
+    CHECK(LoadSmallWorld(bytes));
+
+    bytes = SavedSmallWorld();
+    bytes.pop_back();
+    CHECK(!LoadSmallWorld(bytes)); // short read
+
+    bytes = SavedSmallWorld();
+    bytes[5] = static_cast<uint8_t>(CellType::PlayerObstacle) + 1;
+    CHECK(!LoadSmallWorld(bytes)); // tile out of range
+
+    bytes = SavedSmallWorld();
+    bytes[64 + 5] = static_cast<uint8_t>(ItemType::Coin) + 1;
+    CHECK(!LoadSmallWorld(bytes)); // item out of range
+
+    bytes = SavedSmallWorld();
+    bytes[agentsStart] = 8;
+    CHECK(!LoadSmallWorld(bytes)); // agent off the map
+
+    bytes = SavedSmallWorld();
+    bytes[agentsStart + 9 + 1] = 200;
+    CHECK(!LoadSmallWorld(bytes)); // second agent off the map
+
+    bytes = SavedSmallWorld();
+    bytes[agentsStart + 2] = 2;
+    CHECK(!LoadSmallWorld(bytes)); // not a bool
+
+    bytes = SavedSmallWorld();
+    bytes[agentsStart + 3] = static_cast<uint8_t>(ItemType::Coin) + 1;
+    CHECK(!LoadSmallWorld(bytes)); // held item out of range
+}
+
+// A cancel that arrives after a step committed, e.g. from the step's own callback, is not
+// carried into the next step
+static void TestCancelAfterCommitDoesNotLeak()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(50);
+
+    CHECK(planner.StepAsync([&planner](const std::array<FAgentAction, 3>&) { planner.CancelSearch(); }));
+    planner.WaitForStep();
+    CHECK(!planner.GetLastStepStats().bCancelled);
+
+    planner.CancelSearch();
+    planner.Step();
+    CHECK(!planner.GetLastStepStats().bCancelled);
+    CHECK(planner.GetLastStepStats().TotalRollouts > 0);
+}
+
+static void TestGridViewSpawnsOnce()
+{
+    FView view;
+    std::vector<FGridViewOp> ops;
+    view.ApplyChanges(CellChange(1, 2, CellType::Empty, ItemType::Coin), ops);
+    CHECK(ops.size() == 1);
+    CHECK(IsOp(ops[0], EGridViewOpType::Spawn, EGridVisual::Coin, 0));
+    CHECK(ops[0].X == 1 && ops[0].Y == 2);
+    CHECK(view.GetVisualAt(1, 2) == EGridVisual::Coin);
+
+    // Writing the same contents again changes nothing on screen
+    ops.clear();
+    view.ApplyChanges(CellChange(1, 2, CellType::Empty, ItemType::Coin), ops);
+    CHECK(ops.empty());
+}
+
+static void TestGridViewReusesPooledInstances()
+{
+    FView view;
+    std::vector<FGridViewOp> ops;
+    view.ApplyChanges(CellChange(1, 1, CellType::Empty, ItemType::Coin), ops);
+
+    // Picked up: the coin goes back to its pool
+    ops.clear();
+    view.ApplyChanges(CellChange(1, 1, CellType::Empty, ItemType::None), ops);
+    CHECK(ops.size() == 1);
+    CHECK(IsOp(ops[0], EGridViewOpType::Hide, EGridVisual::Coin, 0));
+
+    // A new coin elsewhere reuses it instead of spawning
+    ops.clear();
+    view.ApplyChanges(CellChange(4, 5, CellType::Empty, ItemType::Coin), ops);
+    CHECK(ops.size() == 1);
+    CHECK(IsOp(ops[0], EGridViewOpType::Show, EGridVisual::Coin, 0));
+    CHECK(ops[0].X == 4 && ops[0].Y == 5);
+
+    // Pools are per visual: a wall still needs an actor of its own
+    ops.clear();
+    view.ApplyChanges(CellChange(4, 5, CellType::Wall, ItemType::Coin), ops);
+    CHECK(ops.size() == 2);
+    CHECK(IsOp(ops[0], EGridViewOpType::Hide, EGridVisual::Coin, 0));
+    CHECK(IsOp(ops[1], EGridViewOpType::Spawn, EGridVisual::Wall, 1));
+
+    CHECK(view.GetStats().Spawns == 2);
+    CHECK(view.GetStats().Shows == 1);
+    CHECK(view.GetStats().Hides == 2);
+    CHECK(view.GetNumInstances() == 2);
+}
+
+static void TestGridViewMovesAgents()
+{
+    FView view;
+    std::vector<FGridViewOp> ops;
+    AgentState agent = {2, 3, false, ItemType::None, 0, false};
+
+    FWorldChangeSet changes;
+    changes.AddAgent(1, agent);
+    view.ApplyChanges(changes, ops);
+    CHECK(ops.size() == 1);
+    CHECK(IsOp(ops[0], EGridViewOpType::Spawn, EGridVisual::Agent, 0));
+
+    // A move is a move, never a respawn
+    agent.x = 3;
+    changes.Reset();
+    changes.AddAgent(1, agent);
+    ops.clear();
+    view.ApplyChanges(changes, ops);
+    CHECK(ops.size() == 1);
+    CHECK(IsOp(ops[0], EGridViewOpType::Move, EGridVisual::Agent, 0));
+    CHECK(ops[0].X == 3 && ops[0].Y == 3);
+
+    // Only the score changed: nothing to show
+    agent.score = 10;
+    changes.Reset();
+    changes.AddAgent(1, agent);
+    ops.clear();
+    view.ApplyChanges(changes, ops);
+    CHECK(ops.empty());
+}
+
+static void TestGridViewSyncAfterSkippedVersions()
+{
+    FSmallWorld world;
+    world.SetTile(0, 0, CellType::Wall);
+    world.SetItem(3, 3, ItemType::Hose);
+    world.agents[1].x = 5;
+
+    FView view;
+    std::vector<FGridViewOp> ops;
+    view.Sync(world, ops);
+    CHECK(view.GetStats().Spawns == 4); // wall, hose, two agents
+
+    // Several versions the view never saw
+    world.SetTile(0, 0, CellType::Empty);
+    world.SetItem(3, 3, ItemType::None);
+    world.SetTile(6, 6, CellType::Fire);
+    world.agents[0].y = 4;
+
+    ops.clear();
+    view.Sync(world, ops);
+    int hides = 0, spawns = 0, moves = 0;
+    for (const FGridViewOp& op : ops)
+    {
+        hides += op.Type == EGridViewOpType::Hide;
+        spawns += op.Type == EGridViewOpType::Spawn;
+        moves += op.Type == EGridViewOpType::Move;
+    }
+    CHECK(hides == 2);
+    CHECK(spawns == 1);
+    CHECK(moves == 1);
+    CHECK(view.GetVisualAt(0, 0) == EGridVisual::None);
+    CHECK(view.GetVisualAt(6, 6) == EGridVisual::Fire);
+
+    // In sync: nothing left to do
+    ops.clear();
+    view.Sync(world, ops);
+    CHECK(ops.empty());
+}
+
+static void TestGridViewFollowsPlanner()
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    planner.SetRolloutsPerAgent(100);
+
+    FGridView<16, 16, 3> view;
+    std::vector<FGridViewOp> ops;
+    view.ApplyChanges(planner.GetWorldSnapshot()->Changes, ops);
+    const int64_t initialSpawns = view.GetStats().Spawns;
+
+    for (int turn = 0; turn < 10; ++turn)
+    {
+        if (turn % 3 == 0)
+        {
+            planner.ApplyWorldEdit(FWorldEdit::SetItem(turn, 8, ItemType::Coin));
+            view.ApplyChanges(planner.GetWorldSnapshot()->Changes, ops);
+        }
+        planner.Step();
+        view.ApplyChanges(planner.GetWorldSnapshot()->Changes, ops);
+    }
+
+    // Every version applied in order leaves the view matching the world
+    ops.clear();
+    view.Sync(planner.GetWorldSnapshot()->State, ops);
+    CHECK(ops.empty());
+    // Far fewer spawns than refreshing the whole board every turn
+    CHECK(view.GetStats().Spawns - initialSpawns <= 4);
+}
+
+int main()
+{
+    TestChangeSetTracksWrites();
+    TestDiffIsExact();
+    TestSnapshotChangesCoverDiff();
+    TestMidTurnEditRestartsRolloutBudget();
+    TestJointSearchHonoursAgentBudget();
+    TestJointSliceCountsAndCancels();
+    TestParallelSearchBatchesLeaves();
+    TestDistanceFieldsFollowPlanner();
+    TestLinearEvaluatorIgnoresStaleFields();
+    TestLoadRejectsCorruptWorlds();
+    TestCancelAfterCommitDoesNotLeak();
+    TestGridViewSpawnsOnce();
+    TestGridViewReusesPooledInstances();
+    TestGridViewMovesAgents();
+    TestGridViewSyncAfterSkippedVersions();
+    TestGridViewFollowsPlanner();
+
+    if (Failures > 0)
+    {
+        std::cerr << Failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include "WorldStateFactory.h"
 #include "FMultiAgentMCTS.h"
+#include "GridView.h"
 #include <conio.h>
 
 template <int W, int H, int N_AGENTS>
@@ -66,6 +67,70 @@ void PrintBoard(const WorldState<W, H, N_AGENTS>& world, int selectedX, int sele
     }
 }
 
+// Plays the demo map once with primitive actions and once with macro-actions and prints
+// the resulting scores and planning time of both modes
+void RunMacroBenchmark(int turns)
+{
+    using namespace HysteriaSim;
+    const char* modeNames[2] = { "primitive", "macro" };
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+        planner.SetUseMacroActions(mode == 1);
+
+        double searchSeconds = 0.0;
+        for (int t = 0; t < turns; ++t)
+        {
+            planner.Step();
+            searchSeconds += planner.GetLastStepStats().SearchSeconds;
+        }
+
+        int totalScore = 0;
+        for (int i = 0; i < 3; ++i)
+            totalScore += planner.GetCurrentState().agents[i].score;
+        std::cout << modeNames[mode] << ": total score " << totalScore << " after " << turns << " turns, "
+                  << searchSeconds * 1000.0 / turns << " ms search per turn\n";
+    }
+}
+
+// Plays the demo map and counts the actors a pooled, change-driven view spawns, reuses and
+// moves per turn, against the actors a full respawn of the board would spawn
+void RunViewBenchmark(int turns)
+{
+    using namespace HysteriaSim;
+    FMultiAgentMCTS<16, 16, 3> planner(CreateDemoMap());
+    FGridView<16, 16, 3> view;
+    std::vector<FGridViewOp> ops;
+    view.ApplyChanges(planner.GetWorldSnapshot()->Changes, ops);
+    const FGridViewStats initial = view.GetStats();
+
+    long long fullSpawns = 0;
+    for (int t = 0; t < turns; ++t)
+    {
+        // An edit every few turns, like a player placing items; it publishes a version of its own
+        if (t % 5 == 0)
+        {
+            planner.ApplyWorldEdit(FWorldEdit::SetItem(t % 16, 8, ItemType::Coin));
+            view.ApplyChanges(planner.GetWorldSnapshot()->Changes, ops);
+        }
+        planner.Step();
+
+        const auto snapshot = planner.GetWorldSnapshot();
+        ops.clear();
+        view.ApplyChanges(snapshot->Changes, ops);
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                fullSpawns += FGridView<16, 16, 3>::GetCellVisual(snapshot->State.grid[y][x], snapshot->State.items[y][x]) != EGridVisual::None;
+        fullSpawns += 3;
+    }
+
+    const FGridViewStats& stats = view.GetStats();
+    std::cout << "initial board: " << initial.Spawns << " spawns\n";
+    std::cout << "per turn: " << double(stats.Spawns - initial.Spawns) / turns << " spawns, "
+              << double(stats.Shows) / turns << " reused, " << double(stats.Hides) / turns << " hidden, "
+              << double(stats.Moves) / turns << " moved; full respawn: " << double(fullSpawns) / turns << " spawns\n";
+}
+
 int main()
 {
     using namespace HysteriaSim;
@@ -77,6 +142,20 @@ int main()
     // 2. Initialize MCTS system
     FMultiAgentMCTS<16, 16, agents> Planner = FMultiAgentMCTS<16, 16, agents>(world);
 
+    // Leaf values shared by the agents' trees across steps
+    Planner.SetLeafCache(1 << 16);
+
+    // Search the next turn while waiting for input
+    Planner.SetPondering(true);
+
+    // Opening book from HysteriaBookBuilder, if one was built
+    auto Book = std::make_shared<FOpeningBook<16, 16, agents>>();
+    if (Book->Load("opening.book"))
+    {
+        std::cout << "Loaded opening book with " << Book->Num() << " positions\n";
+        Planner.SetOpeningBook(Book);
+    }
+
     // 3. Print planned actions
     for (int i = 0; i < agents; ++i)
     {
@@ -88,7 +167,9 @@ int main()
 
     int selX = 0, selY = 0;
     while (true) {
-        PrintBoard(Planner.GetCurrentState(), selX, selY);
+        // Edits queue up as keys are pressed and go in together before the next draw
+        Planner.ApplyQueuedEdits();
+        PrintBoard(Planner.GetWorldSnapshot()->State, selX, selY);
         std::cout << "Use WASD to move, c to put a coint, SPACE to step, q to quit\n";
         std::cout << "\t c => coin";
         std::cout << "\t p => pickaxe \n";
@@ -97,47 +178,90 @@ int main()
         std::cout << "\t e => wall";
         std::cout << "\t o => obstacle \n";
         std::cout << "\t r => fire";
+        std::cout << "\t m => move agent 0 \n";
+        std::cout << "\t b => benchmark primitive vs macro actions \n";
+        std::cout << "\t v => benchmark grid view refresh \n";
+#if HYSTERIA_TRACE
+        std::cout << "\t t => save timeline trace \n";
+#endif
+        std::cout << "\t k => save planner snapshot";
+        std::cout << "\t l => load planner snapshot";
         char c = _getch(); // or std::cin.get(), but _getch() doesn't require enter
         if (c == 'q') break;
         if (c == 'c')
         {
             //Place a coin at the selected position
-            Planner.GetCurrentState().SetItem(selX, selY, ItemType::Coin);
+            Planner.QueueWorldEdit(FWorldEdit::SetItem(selX, selY, ItemType::Coin));
         }
         if(c == 'p')
         {
             //Place a pickaxe at the selected position
-            Planner.GetCurrentState().SetItem(selX, selY, ItemType::Pickaxe);
+            Planner.QueueWorldEdit(FWorldEdit::SetItem(selX, selY, ItemType::Pickaxe));
         }
         if(c == 'h')
         {
             //Place a hose at the selected position
-            Planner.GetCurrentState().SetItem(selX, selY, ItemType::Hose);
+            Planner.QueueWorldEdit(FWorldEdit::SetItem(selX, selY, ItemType::Hose));
         }
         if(c == 'f')
         {
             //Place a food at the selected position
-            Planner.GetCurrentState().SetItem(selX, selY, ItemType::Food);
+            Planner.QueueWorldEdit(FWorldEdit::SetItem(selX, selY, ItemType::Food));
         }
         if(c == 'o')
         {
             //Place a obstacle at the selected position
-            Planner.GetCurrentState().SetTile(selX, selY, CellType::PlayerObstacle);
+            Planner.QueueWorldEdit(FWorldEdit::SetTile(selX, selY, CellType::PlayerObstacle));
         }
         if(c == 'e')
         {
             //Place a wall at the selected position
-            Planner.GetCurrentState().SetTile(selX, selY, CellType::Wall);
+            Planner.QueueWorldEdit(FWorldEdit::SetTile(selX, selY, CellType::Wall));
         }
         if( c == 'r')
         {
             //place a fire
-            Planner.GetCurrentState().SetTile(selX, selY, CellType::Fire);
+            Planner.QueueWorldEdit(FWorldEdit::SetTile(selX, selY, CellType::Fire));
+        }
+        if (c == 'm')
+        {
+            //Move agent 0 to the selected position
+            Planner.QueueWorldEdit(FWorldEdit::MoveAgent(0, selX, selY));
         }
         if (c == 'w' && selY > 0) --selY;
         if (c == 's' && selY < 16-1) ++selY;
         if (c == 'a' && selX > 0) --selX;
         if (c == 'd' && selX < 16-1) ++selX;
+        if (c == 'b')
+        {
+            RunMacroBenchmark(30);
+            std::cout << "Press any key to continue\n";
+            _getch();
+        }
+        if (c == 'v')
+        {
+            RunViewBenchmark(30);
+            std::cout << "Press any key to continue\n";
+            _getch();
+        }
+#if HYSTERIA_TRACE
+        if (c == 't')
+        {
+            // Open in chrome://tracing or ui.perfetto.dev
+            Planner.StopPondering();
+            const bool ok = HysteriaTrace::FRecorder::Get().WriteChromeTrace("hysteria.trace.json");
+            std::cout << (ok ? "Trace saved to hysteria.trace.json" : "Trace save failed") << ", press any key to continue\n";
+            _getch();
+        }
+#endif
+        if (c == 'k' || c == 'l')
+        {
+            // Warm restart: trees and trajectories survive a restart of the CLI
+            Planner.StopPondering();
+            const bool ok = c == 'k' ? Planner.SaveSnapshot("planner.snapshot") : Planner.LoadSnapshot("planner.snapshot");
+            std::cout << (c == 'k' ? "Save " : "Load ") << (ok ? "succeeded" : "failed") << ", press any key to continue\n";
+            _getch();
+        }
         if (c == ' ') {
             // Advance simulation
             Planner.Step();
@@ -1,4 +1,5 @@
 #include "GridManager.h"
+#include "Async/Async.h"
 #include "Engine/World.h"
 #include "GameFramework/PlayerController.h"
 #include "Kismet/GameplayStatics.h"
@@ -7,8 +8,9 @@
 AGridManager::AGridManager() : CurrentTool(EInputAction::None)
 {
 	Planner = new FMultiAgentMCTS<16, 16, 3>(HysteriaSim::CreateDemoMap());
-	PrimaryActorTick.bCanEverTick = false;
-	PlacedActors = TArray<AActor*>();
+	// Ticks only while a time-sliced turn is searched or edits wait to be applied
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 }
 
 AGridManager::~AGridManager()
@@ -16,9 +18,9 @@ AGridManager::~AGridManager()
 	delete Planner;
 }
 
-WorldState<16, 16, 3> AGridManager::GetPlannerWorld() const
+FMultiAgentMCTS<16, 16, 3>::FWorldSnapshotPtr AGridManager::GetPlannerWorld() const
 {
-	return Planner->GetCurrentState();
+	return Planner->GetWorldSnapshot();
 }
 
 void AGridManager::BeginPlay()
@@ -37,6 +39,12 @@ void AGridManager::BeginPlay()
 		PC->bEnableMouseOverEvents = true;
 	}
 
+	// Search the next turn while the player is still deciding. Started here rather than in the
+	// constructor, which also runs for the class default object and for editor-placed actors.
+	// Pondering needs a thread of its own, which time-sliced planning does without.
+	if (!bTimeSlicedPlanning)
+		Planner->SetPondering(true);
+
 	UE_LOG(LogTemp, Log, TEXT("GridManager initialized!"));
 
 	ShowWorldState();
@@ -46,8 +54,59 @@ void AGridManager::NextTurn()
 {
 	if (!Planner)
 		Planner = new FMultiAgentMCTS<16, 16, 3>(HysteriaSim::CreateDemoMap());
-	Planner->Step();
-	ShowWorldState();
+	if (Planner->IsStepInProgress() || bTurnPending)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Planner is still searching the current turn"));
+		return;
+	}
+
+	if (bTimeSlicedPlanning)
+	{
+		Planner->BeginTurn();
+		bTurnPending = true;
+		SetActorTickEnabled(true);
+		return;
+	}
+
+	// Search off the game thread and redraw on it once the turn is done
+	TWeakObjectPtr<AGridManager> WeakThis(this);
+	Planner->StepAsync([WeakThis](const std::array<FAgentAction, 3>&)
+	{
+		AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+		{
+			if (WeakThis.IsValid())
+				WeakThis->ShowWorldState();
+		});
+	});
+}
+
+void AGridManager::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+	if (bTurnPending)
+	{
+		// The slice applies the edits queued since the last one first
+		const bool bEdited = Planner->HasQueuedEdits();
+		if (Planner->AdvanceTurn(TNumericLimits<int32>::Max(), PlanningMillisecondsPerTick / 1000.0))
+		{
+			Planner->CommitTurn();
+			bTurnPending = false;
+			SetActorTickEnabled(Planner->HasQueuedEdits());
+			ShowWorldState();
+		}
+		else if (bEdited)
+		{
+			ShowWorldState();
+		}
+		return;
+	}
+
+	// Edits from this frame go in as one batch; a running step applies them when it commits
+	if (Planner->IsStepInProgress())
+		return;
+	if (Planner->ApplyQueuedEdits() > 0)
+		ShowWorldState();
+	SetActorTickEnabled(false);
 }
 
 void AGridManager::SetTool(const EInputAction NewTool)
@@ -91,82 +150,81 @@ void AGridManager::SetTool(const EInputAction NewTool)
 
 void AGridManager::ShowWorldState()
 {
-	// Clear previously placed actors
-	for (AActor* Actor : PlacedActors)
-	{
-		if (Actor)
-		{
-			Actor->Destroy();
-		}
-	}
-
-	// Clear the array
-	PlacedActors.Empty();
+	// One handle for the whole refresh: no copies, and a search running meanwhile cannot tear it
+	const FMultiAgentMCTS<16, 16, 3>::FWorldSnapshotPtr Snapshot = GetPlannerWorld();
+	if (!Snapshot || Snapshot->Version == ShownWorldVersion)
+		return;
 
-	// Spawn agents
+	// The next version's change set is enough; after a gap, compare the whole world
+	TArray<FGridViewOp> Ops;
+	if (Snapshot->Version == ShownWorldVersion + 1)
+		View.ApplyChanges(Snapshot->Changes, Ops);
+	else
+		View.Sync(Snapshot->State, Ops);
+	ShownWorldVersion = Snapshot->Version;
 
-	for (int i = 0; i < GetPlannerWorld().GetAgentCount(); ++i)
+	// Actors are pooled per visual: hidden ones are shown again before anything is spawned
+	for (const FGridViewOp& Op : Ops)
 	{
-		FVector WorldPosition = ToWorldCoords(GetPlannerWorld().agents[i].x, GetPlannerWorld().agents[i].y);
-		if (AgentBlueprintClass)
+		switch (Op.Type)
 		{
-			auto* spawned = GetWorld()->SpawnActor<AActor>(AgentBlueprintClass, WorldPosition, FRotator::ZeroRotator);
-			PlacedActors.Add(spawned);
-		}
-	}
-
-	for (int x = 0; x < 16; x++)
-	{
-		for (int y = 0; y < 16; y++)
+		case EGridViewOpType::Spawn:
 		{
-			FVector WorldPosition = ToWorldCoords(x, y);
-			TSubclassOf<AActor> ItemBlueprintClass = nullptr;
-
-			switch (GetPlannerWorld().grid[y][x])
-			{
-			case CellType::Wall:
-				ItemBlueprintClass = WallBlueprintClass;
-				break;
-			case CellType::Fire:
-				ItemBlueprintClass = FireBlueprintClass;
-				break;
-			case CellType::PlayerObstacle:
-				ItemBlueprintClass = BoulderBlueprintClass;
-				break;
-			default:
-				break;
-			}
-
-			if (ItemBlueprintClass == nullptr && GetPlannerWorld().items[y][x] != ItemType::None)
+			// Instances are numbered in spawn order, so the new actor's index is its instance
+			AActor* Spawned = nullptr;
+			if (TSubclassOf<AActor> VisualClass = GetVisualClass(Op.Visual))
+				Spawned = GetWorld()->SpawnActor<AActor>(VisualClass, ToWorldCoords(Op.X, Op.Y), FRotator::ZeroRotator);
+			ViewActors.Add(Spawned);
+			break;
+		}
+		case EGridViewOpType::Show:
+			if (AActor* Actor = ViewActors[Op.Instance])
 			{
-				switch (GetPlannerWorld().items[y][x])
-				{
-				case ItemType::Coin:
-					ItemBlueprintClass = CoinBlueprintClass;
-					break;
-				case ItemType::Hose:
-					ItemBlueprintClass = WaterHoseBlueprintClass;
-					break;
-				case ItemType::Food:
-					ItemBlueprintClass = AppleBlueprintClass;
-					break;
-				case ItemType::Pickaxe:
-					ItemBlueprintClass = PickaxeBlueprintClass;
-					break;
-				default:
-					ItemBlueprintClass = nullptr; // No item to spawn
-				}
+				Actor->SetActorLocation(ToWorldCoords(Op.X, Op.Y));
+				Actor->SetActorHiddenInGame(false);
+				Actor->SetActorEnableCollision(true);
 			}
-			if (ItemBlueprintClass)
+			break;
+		case EGridViewOpType::Hide:
+			if (AActor* Actor = ViewActors[Op.Instance])
 			{
-				auto* spawned = GetWorld()->SpawnActor<
-					AActor>(ItemBlueprintClass, WorldPosition, FRotator::ZeroRotator);
-				PlacedActors.Add(spawned);
+				Actor->SetActorHiddenInGame(true);
+				Actor->SetActorEnableCollision(false);
 			}
+			break;
+		case EGridViewOpType::Move:
+			if (AActor* Actor = ViewActors[Op.Instance])
+				Actor->SetActorLocation(ToWorldCoords(Op.X, Op.Y));
+			break;
 		}
 	}
 }
 
+TSubclassOf<AActor> AGridManager::GetVisualClass(const EGridVisual Visual) const
+{
+	switch (Visual)
+	{
+	case EGridVisual::Wall:
+		return WallBlueprintClass;
+	case EGridVisual::Fire:
+		return FireBlueprintClass;
+	case EGridVisual::Boulder:
+		return BoulderBlueprintClass;
+	case EGridVisual::Coin:
+		return CoinBlueprintClass;
+	case EGridVisual::Hose:
+		return WaterHoseBlueprintClass;
+	case EGridVisual::Apple:
+		return AppleBlueprintClass;
+	case EGridVisual::Pickaxe:
+		return PickaxeBlueprintClass;
+	case EGridVisual::Agent:
+		return AgentBlueprintClass;
+	default:
+		return nullptr;
+	}
+}
+
 FVector AGridManager::ToWorldCoords(int32 const X, int32 const Y) const
 {
 	return FVector(750 - Y * 100, -650 + X * 100, 0);
@@ -201,35 +259,42 @@ void AGridManager::HandleToolAt(int32 X, int32 Y)
 	switch (CurrentTool)
 	{
 	case EInputAction::Erase:
-		Planner->GetCurrentState().SetItem(X, Y, ItemType::None); // Erase item
-		Planner->GetCurrentState().SetTile(X, Y, CellType::Empty); // Erase cell
+	{
+		// Erase item and cell
+		const FWorldEdit Erase[] = {FWorldEdit::SetItem(X, Y, ItemType::None), FWorldEdit::SetTile(X, Y, CellType::Empty)};
+		Planner->QueueWorldEdits(Erase, 2);
 		break;
+	}
 	case EInputAction::PlaceBoulder:
-		Planner->GetCurrentState().SetTile(X, Y, CellType::PlayerObstacle); // Place boulder
+		Planner->QueueWorldEdit(FWorldEdit::SetTile(X, Y, CellType::PlayerObstacle)); // Place boulder
 		break;
 	case EInputAction::PlaceFire:
-		Planner->GetCurrentState().SetTile(X, Y, CellType::Fire); // Place fire
+		Planner->QueueWorldEdit(FWorldEdit::SetTile(X, Y, CellType::Fire)); // Place fire
 		break;
 	case EInputAction::PlaceWall:
-		Planner->GetCurrentState().SetTile(X, Y, CellType::Wall); // Place wall
+		Planner->QueueWorldEdit(FWorldEdit::SetTile(X, Y, CellType::Wall)); // Place wall
 		break;
 	case EInputAction::PlaceCoin:
-		Planner->GetCurrentState().SetItem(X, Y, ItemType::Coin); // Place coin
+		Planner->QueueWorldEdit(FWorldEdit::SetItem(X, Y, ItemType::Coin)); // Place coin
 		break;
 	case EInputAction::PlaceWaterHose:
-		Planner->GetCurrentState().SetItem(X, Y, ItemType::Hose); // Place water hose
+		Planner->QueueWorldEdit(FWorldEdit::SetItem(X, Y, ItemType::Hose)); // Place water hose
 		break;
 	case EInputAction::PlaceApple:
-		Planner->GetCurrentState().SetItem(X, Y, ItemType::Food); // Place apple
+		Planner->QueueWorldEdit(FWorldEdit::SetItem(X, Y, ItemType::Food)); // Place apple
 		break;
 	case EInputAction::PlacePickaxe:
-		Planner->GetCurrentState().SetItem(X, Y, ItemType::Pickaxe); // Place pickaxe
+		Planner->QueueWorldEdit(FWorldEdit::SetItem(X, Y, ItemType::Pickaxe)); // Place pickaxe
 		break;
 	default:
 		break; // No action for None tool
 	}
 
-	ShowWorldState(); // Refresh the grid display
+	// The planner applies the queued edits at its next safe point, and a running search is
+	// stale: cut it short so the turn commits what it found so far, edits included
+	if (Planner->IsStepInProgress())
+		Planner->CancelSearch();
+	SetActorTickEnabled(true); // Tick applies the edits and refreshes the grid display
 }
 
 bool AGridManager::GetMouseGridCoords(int32& OutX, int32& OutY) const
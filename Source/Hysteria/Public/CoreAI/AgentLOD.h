@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include "GridSearch.h"
+#include <array>
+#include <algorithm>
+#include <cstdlib>
+
+// Level-of-detail AI: a near-free reactive policy for unimportant agents and
+// an importance ranking that decides which agents get a full tree search.
+template <int W, int H, int N_AGENTS>
+struct FReactivePolicy
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+
+	// Greedy rules: use a held tool next to its target, pick up what we stand on,
+	// otherwise walk towards the nearest fire (with hose), coin or useful item.
+	// With distance fields, walking follows their flow field instead of running a BFS.
+	static FAgentAction GetAction(const FWorldState& State, int Agent, const FDistanceFieldCache<W, H>* Fields = nullptr)
+	{
+		const AgentState& agent = State.agents[Agent];
+		const ItemType held = agent.hasItem ? agent.item : ItemType::None;
+		const ItemType under = State.items[agent.y][agent.x];
+
+		if (held == ItemType::Hose && GridSearch::HasNeighborCell(State, agent.x, agent.y, CellType::Fire))
+			return FAgentAction(EActionType::UseItem);
+		if (held == ItemType::Pickaxe && GridSearch::HasNeighborCell(State, agent.x, agent.y, CellType::PlayerObstacle))
+			return FAgentAction(EActionType::UseItem);
+		const bool bHoseUseful = ContainsCell(State, CellType::Fire);
+		const bool bPickaxeUseful = ContainsCell(State, CellType::PlayerObstacle);
+		auto IsWanted = [held, bHoseUseful, bPickaxeUseful](ItemType Item)
+		{
+			return Item == ItemType::Coin || (held == ItemType::None &&
+				((Item == ItemType::Hose && bHoseUseful) || (Item == ItemType::Pickaxe && bPickaxeUseful)));
+		};
+
+		if (IsWanted(under))
+			return FAgentAction(EActionType::Pickup);
+
+		if (Fields)
+		{
+			EDistanceTarget target = EDistanceTarget::Count;
+			int best = -1;
+			auto Consider = [&](EDistanceTarget Candidate)
+			{
+				const int d = Fields->GetDistance(Candidate, agent.x, agent.y);
+				if (d > 0 && (best < 0 || d < best))
+				{
+					best = d;
+					target = Candidate;
+				}
+			};
+			if (held == ItemType::Hose)
+				Consider(EDistanceTarget::Fire);
+			if (target == EDistanceTarget::Count)
+			{
+				Consider(EDistanceTarget::Coin);
+				if (held == ItemType::None && bHoseUseful) Consider(EDistanceTarget::Hose);
+				if (held == ItemType::None && bPickaxeUseful) Consider(EDistanceTarget::Pickaxe);
+			}
+			if (target != EDistanceTarget::Count)
+				return FAgentAction(Fields->GetStepTowards(target, agent.x, agent.y));
+			return FAgentAction(EActionType::Wait);
+		}
+
+		EActionType step;
+		if (held == ItemType::Hose &&
+			GridSearch::FindNearest(State, agent.x, agent.y, [&State](int X, int Y)
+			{
+				return GridSearch::HasNeighborCell(State, X, Y, CellType::Fire);
+			}, step) > 0)
+			return FAgentAction(step);
+
+		if (GridSearch::FindNearest(State, agent.x, agent.y, [&State, &IsWanted](int X, int Y)
+		{
+			return IsWanted(State.items[Y][X]);
+		}, step) > 0)
+			return FAgentAction(step);
+
+		return FAgentAction(EActionType::Wait);
+	}
+
+	// Rolls the policy forward on a copy of the world (ignoring the other agents) so that
+	// searching agents can predict what a reactive agent will do next. Fields belong to State,
+	// so they only drive the first move; later plies see the agent's own pickups.
+	static HYSTERIA_VECTOR<FAgentAction> PlanTrajectory(const FWorldState& State, int Agent, int Length,
+	                                                    const FDistanceFieldCache<W, H>* Fields = nullptr)
+	{
+		HYSTERIA_VECTOR<FAgentAction> trajectory;
+		FWorldState simState = State;
+		for (int i = 0; i < Length; ++i)
+		{
+			FAgentAction action = GetAction(simState, Agent, i == 0 ? Fields : nullptr);
+#ifdef HYSTERIA_USE_UNREAL
+			trajectory.Add(action);
+#else
+			trajectory.push_back(action);
+#endif
+			if (simState.CanExecute(Agent, action))
+				simState.ApplyAgentAction(Agent, action);
+		}
+		return trajectory;
+	}
+
+	static bool ContainsCell(const FWorldState& State, CellType Type)
+	{
+		for (int y = 0; y < H; ++y)
+			for (int x = 0; x < W; ++x)
+				if (State.grid[y][x] == Type)
+					return true;
+		return false;
+	}
+};
+
+template <int W, int H, int N_AGENTS>
+struct FAgentImportance
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+
+	// Higher is more important. Each term is 1 / (1 + manhattan distance) to the nearest
+	// fire, item and other agent, so agents in the middle of the action score highest.
+	static double Score(const FWorldState& State, int Agent)
+	{
+		const AgentState& agent = State.agents[Agent];
+		int nearestFire = W + H;
+		int nearestItem = W + H;
+		int nearestAgent = W + H;
+
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				const int d = std::abs(x - agent.x) + std::abs(y - agent.y);
+				if (State.grid[y][x] == CellType::Fire && d < nearestFire) nearestFire = d;
+				if (State.items[y][x] != ItemType::None && d < nearestItem) nearestItem = d;
+			}
+		}
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			if (i == Agent) continue;
+			const int d = std::abs(State.agents[i].x - agent.x) + std::abs(State.agents[i].y - agent.y);
+			if (d < nearestAgent) nearestAgent = d;
+		}
+
+		return 1.0 / (1 + nearestFire) + 1.0 / (1 + nearestItem) + 1.0 / (1 + nearestAgent);
+	}
+
+	// Marks the Budget most important agents for full tree search
+	static std::array<bool, N_AGENTS> SelectSearchAgents(const FWorldState& State, int Budget)
+	{
+		std::array<bool, N_AGENTS> selected = {};
+		if (Budget >= N_AGENTS)
+		{
+			selected.fill(true);
+			return selected;
+		}
+
+		std::array<double, N_AGENTS> scores;
+		std::array<int, N_AGENTS> order;
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			scores[i] = Score(State, i);
+			order[i] = i;
+		}
+
+		const int budget = Budget < 0 ? 0 : Budget;
+		std::nth_element(order.begin(), order.begin() + budget, order.end(), [&scores](int A, int B)
+		{
+			return scores[A] > scores[B];
+		});
+		for (int n = 0; n < budget; ++n)
+			selected[order[n]] = true;
+		return selected;
+	}
+};
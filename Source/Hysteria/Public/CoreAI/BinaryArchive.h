@@ -0,0 +1,196 @@
+#pragma once
+
+#include "Types.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#ifdef HYSTERIA_USE_UNREAL
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Templates/UniquePtr.h"
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+// Flat native-endian binary files for planner snapshots. Values are written field by field,
+// so the layout does not depend on struct padding.
+
+class FBinaryWriter
+{
+public:
+	template <typename T>
+	void Write(const T& Value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&Value);
+		Bytes.insert(Bytes.end(), bytes, bytes + sizeof(T));
+	}
+
+	void WriteBytes(const void* Data, size_t Size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(Data);
+		Bytes.insert(Bytes.end(), bytes, bytes + Size);
+	}
+
+	// Everything written so far, e.g. to read it back without a file
+	const std::vector<uint8_t>& GetBytes() const
+	{
+		return Bytes;
+	}
+
+	bool SaveToFile(const HYSTERIA_STRING& Path) const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return FFileHelper::SaveArrayToFile(TArrayView<const uint8>(Bytes.data(), static_cast<int32>(Bytes.size())), *Path);
+#else
+		std::ofstream file(Path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(Bytes.data()), static_cast<std::streamsize>(Bytes.size()));
+		return static_cast<bool>(file);
+#endif
+	}
+
+private:
+	std::vector<uint8_t> Bytes;
+};
+
+// Reads from memory it does not own, typically a FMappedFile. Every read is bounds checked;
+// after the first failed read all further reads fail too.
+class FBinaryReader
+{
+public:
+	FBinaryReader(const uint8_t* InData, size_t InSize)
+		: Data(InData), Size(InSize)
+	{
+	}
+
+	template <typename T>
+	bool Read(T& OutValue)
+	{
+		return ReadBytes(&OutValue, sizeof(T));
+	}
+
+	bool ReadBytes(void* OutData, size_t Count)
+	{
+		if (bFailed || Count > Size - Offset)
+		{
+			bFailed = true;
+			return false;
+		}
+		std::memcpy(OutData, Data + Offset, Count);
+		Offset += Count;
+		return true;
+	}
+
+	bool HasFailed() const
+	{
+		return bFailed;
+	}
+
+private:
+	const uint8_t* Data;
+	size_t Size;
+	size_t Offset = 0;
+	bool bFailed = false;
+};
+
+// Read-only memory mapping of a whole file, so loading a snapshot does not copy it first
+class FMappedFile
+{
+public:
+	FMappedFile() = default;
+	FMappedFile(const FMappedFile&) = delete;
+	FMappedFile& operator=(const FMappedFile&) = delete;
+
+	~FMappedFile()
+	{
+		Close();
+	}
+
+	bool Open(const HYSTERIA_STRING& Path)
+	{
+		Close();
+#ifdef HYSTERIA_USE_UNREAL
+		Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+		if (!Handle || Handle->GetFileSize() <= 0) return false;
+		Region.Reset(Handle->MapRegion(0, Handle->GetFileSize()));
+		if (!Region) return false;
+		Data = Region->GetMappedPtr();
+		Size = static_cast<size_t>(Region->GetMappedSize());
+#elif defined(_WIN32)
+		File = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (File == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(File, &fileSize) || fileSize.QuadPart == 0) return false;
+		Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!Mapping) return false;
+		Data = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+		Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		Descriptor = open(Path.c_str(), O_RDONLY);
+		if (Descriptor < 0) return false;
+		struct stat info;
+		if (fstat(Descriptor, &info) != 0 || info.st_size == 0) return false;
+		void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, Descriptor, 0);
+		if (mapped == MAP_FAILED) return false;
+		Data = static_cast<const uint8_t*>(mapped);
+		Size = static_cast<size_t>(info.st_size);
+#endif
+		return Data != nullptr;
+	}
+
+	void Close()
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		Region.Reset();
+		Handle.Reset();
+#elif defined(_WIN32)
+		if (Data) UnmapViewOfFile(Data);
+		if (Mapping) CloseHandle(Mapping);
+		if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+		Mapping = nullptr;
+		File = INVALID_HANDLE_VALUE;
+#else
+		if (Data) munmap(const_cast<uint8_t*>(Data), Size);
+		if (Descriptor >= 0) close(Descriptor);
+		Descriptor = -1;
+#endif
+		Data = nullptr;
+		Size = 0;
+	}
+
+	const uint8_t* GetData() const
+	{
+		return Data;
+	}
+
+	size_t GetSize() const
+	{
+		return Size;
+	}
+
+private:
+	const uint8_t* Data = nullptr;
+	size_t Size = 0;
+#ifdef HYSTERIA_USE_UNREAL
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+#elif defined(_WIN32)
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = nullptr;
+#else
+	int Descriptor = -1;
+#endif
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Types.h"
+#include <atomic>
+
+// Cooperative cancellation of a running search. The owner calls Cancel from any thread;
+// rollout workers check IsCancelled before every rollout and return, so a cancelled search
+// goes idle within one rollout per worker and the trees keep everything searched so far.
+class FCancellationToken
+{
+public:
+	void Cancel()
+	{
+		// The first request's time counts; it is set before the flag that workers read
+		double unset = 0.0;
+		CancelTime.compare_exchange_strong(unset, HysteriaNowSeconds());
+		bCancelled = true;
+	}
+
+	bool IsCancelled() const
+	{
+		return bCancelled.load(std::memory_order_relaxed);
+	}
+
+	// Seconds since Cancel, 0 if not cancelled; taken once the workers are idle, this is the
+	// cancel-to-idle latency
+	double GetSecondsSinceCancel() const
+	{
+		return bCancelled.load() ? HysteriaNowSeconds() - CancelTime.load() : 0.0;
+	}
+
+	// Only while no search uses the token
+	void Reset()
+	{
+		bCancelled = false;
+		CancelTime = 0.0;
+	}
+
+private:
+	std::atomic<bool> bCancelled{false};
+	std::atomic<double> CancelTime{0.0};
+};
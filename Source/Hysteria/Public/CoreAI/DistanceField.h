@@ -0,0 +1,275 @@
+#pragma once
+
+#include "Types.h"
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// What a distance field measures the walking distance to
+enum class EDistanceTarget : uint8_t
+{
+	Coin,
+	Food,
+	Hose,
+	Pickaxe,
+	Fire,     // walkable cells next to fire, i.e. where a hose can be used
+	Obstacle, // walkable cells next to a player obstacle, i.e. where a pickaxe can be used
+	Count
+};
+
+// BFS distance fields over walkable (CellType::Empty) cells, one per EDistanceTarget.
+// Fields are built once and then repaired locally when a cell changes, so a query is a
+// single table load. The cache does not watch a world: whoever owns it reports the cells
+// that changed, after writing them.
+template <int W, int H>
+class FDistanceFieldCache
+{
+public:
+	static constexpr uint16_t Unreachable = 0xFFFF;
+	static constexpr int NumTargets = static_cast<int>(EDistanceTarget::Count);
+
+	// Walking distance from (X, Y) to the nearest target cell, -1 if unreachable
+	int GetDistance(EDistanceTarget Target, int X, int Y) const
+	{
+		const uint16_t d = Distances[static_cast<int>(Target)][Y * W + X];
+		return d == Unreachable ? -1 : d;
+	}
+
+	// Flow field: the move that decreases the distance to Target, Wait if already there or unreachable
+	EActionType GetStepTowards(EDistanceTarget Target, int X, int Y) const
+	{
+		const uint16_t* field = Distances[static_cast<int>(Target)];
+		const uint16_t d = field[Y * W + X];
+		if (d == 0 || d == Unreachable) return EActionType::Wait;
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int nx = X + DX[dir];
+			const int ny = Y + DY[dir];
+			if (InBounds(nx, ny) && field[ny * W + nx] == d - 1)
+				return Moves[dir];
+		}
+		return EActionType::Wait;
+	}
+
+	// Full multi-source BFS for every target
+	void Rebuild(const CellType (&Grid)[H][W], const ItemType (&Items)[H][W])
+	{
+		for (int t = 0; t < NumTargets; ++t)
+		{
+			uint16_t* field = Distances[t];
+			for (int i = 0; i < W * H; ++i)
+				field[i] = Unreachable;
+
+			int head = 0, tail = 0;
+			for (int i = 0; i < W * H; ++i)
+			{
+				if (IsSource(static_cast<EDistanceTarget>(t), Grid, Items, i % W, i / W))
+				{
+					field[i] = 0;
+					Queue[tail++] = i;
+				}
+			}
+			while (head < tail)
+			{
+				const int cell = Queue[head++];
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					const int nx = cell % W + DX[dir];
+					const int ny = cell / W + DY[dir];
+					if (!InBounds(nx, ny) || Grid[ny][nx] != CellType::Empty) continue;
+					const int next = ny * W + nx;
+					if (field[next] != Unreachable) continue;
+					field[next] = field[cell] + 1;
+					Queue[tail++] = next;
+				}
+			}
+		}
+	}
+
+	// Repairs every field after the tile or item at (X, Y) changed. Only the cells whose
+	// shortest path ran through the changed area are recomputed.
+	void OnCellChanged(const CellType (&Grid)[H][W], const ItemType (&Items)[H][W], int X, int Y)
+	{
+		const int cell = Y * W + X;
+		OnCellsChanged(Grid, Items, &cell, 1);
+	}
+
+	// Same for a batch of cells (indices Y * W + X) written since the fields were last
+	// repaired, in one pass per field
+	void OnCellsChanged(const CellType (&Grid)[H][W], const ItemType (&Items)[H][W], const int* Cells, int NumCells)
+	{
+		// The cells themselves and their neighbours: fire/obstacle sources depend on adjacency
+		int numChanged = 0;
+		for (int i = 0; i < NumCells; ++i)
+		{
+			const int x = Cells[i] % W;
+			const int y = Cells[i] / W;
+			AddChanged(Cells[i], numChanged);
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				if (InBounds(x + DX[dir], y + DY[dir]))
+					AddChanged((y + DY[dir]) * W + x + DX[dir], numChanged);
+			}
+		}
+		for (int i = 0; i < numChanged; ++i)
+			InChanged[Changed[i]] = 0;
+
+		for (int t = 0; t < NumTargets; ++t)
+			Repair(static_cast<EDistanceTarget>(t), Grid, Items, Changed, numChanged);
+	}
+
+private:
+	static constexpr int DX[4] = {0, 0, -1, 1};
+	static constexpr int DY[4] = {1, -1, 0, 0};
+	static constexpr EActionType Moves[4] = {
+		EActionType::MoveDown, EActionType::MoveUp, EActionType::MoveLeft, EActionType::MoveRight
+	};
+
+	uint16_t Distances[NumTargets][W * H];
+
+	// Scratch for BFS and repairs
+	int Queue[W * H];
+	uint8_t InRegion[W * H] = {};
+	int Changed[W * H];
+	uint8_t InChanged[W * H] = {};
+
+	void AddChanged(int Cell, int& NumChanged)
+	{
+		if (InChanged[Cell]) return;
+		InChanged[Cell] = 1;
+		Changed[NumChanged++] = Cell;
+	}
+
+	static bool InBounds(int X, int Y)
+	{
+		return X >= 0 && X < W && Y >= 0 && Y < H;
+	}
+
+	static bool HasNeighbor(const CellType (&Grid)[H][W], int X, int Y, CellType Type)
+	{
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int nx = X + DX[dir];
+			const int ny = Y + DY[dir];
+			if (InBounds(nx, ny) && Grid[ny][nx] == Type)
+				return true;
+		}
+		return false;
+	}
+
+	static bool IsSource(EDistanceTarget Target, const CellType (&Grid)[H][W], const ItemType (&Items)[H][W],
+	                     int X, int Y)
+	{
+		if (Grid[Y][X] != CellType::Empty) return false;
+		switch (Target)
+		{
+		case EDistanceTarget::Coin:
+			return Items[Y][X] == ItemType::Coin;
+		case EDistanceTarget::Food:
+			return Items[Y][X] == ItemType::Food;
+		case EDistanceTarget::Hose:
+			return Items[Y][X] == ItemType::Hose;
+		case EDistanceTarget::Pickaxe:
+			return Items[Y][X] == ItemType::Pickaxe;
+		case EDistanceTarget::Fire:
+			return HasNeighbor(Grid, X, Y, CellType::Fire);
+		case EDistanceTarget::Obstacle:
+			return HasNeighbor(Grid, X, Y, CellType::PlayerObstacle);
+		default:
+			return false;
+		}
+	}
+
+	void Repair(EDistanceTarget Target, const CellType (&Grid)[H][W], const ItemType (&Items)[H][W],
+	            const int* Changed, int NumChanged)
+	{
+		uint16_t* field = Distances[static_cast<int>(Target)];
+
+		// 1. Invalidate the changed cells and everything downstream of them (cells whose
+		//    distance is exactly one more than a cell already invalidated)
+		int head = 0, tail = 0;
+		for (int i = 0; i < NumChanged; ++i)
+		{
+			const int cell = Changed[i];
+			if (InRegion[cell]) continue;
+			InRegion[cell] = 1;
+			Queue[tail++] = cell;
+		}
+		while (head < tail)
+		{
+			const int cell = Queue[head++];
+			if (field[cell] == Unreachable) continue;
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int nx = cell % W + DX[dir];
+				const int ny = cell / W + DY[dir];
+				if (!InBounds(nx, ny)) continue;
+				const int next = ny * W + nx;
+				if (InRegion[next] || field[next] == Unreachable || field[next] != field[cell] + 1) continue;
+				InRegion[next] = 1;
+				Queue[tail++] = next;
+			}
+		}
+		for (int i = 0; i < tail; ++i)
+			field[Queue[i]] = Unreachable;
+
+		// 2. Seed the invalidated region from its sources and its valid border
+		using FEntry = std::pair<uint16_t, int>;
+		std::priority_queue<FEntry, std::vector<FEntry>, std::greater<FEntry>> open;
+		for (int i = 0; i < tail; ++i)
+		{
+			const int cell = Queue[i];
+			InRegion[cell] = 0;
+			const int cx = cell % W;
+			const int cy = cell / W;
+			if (Grid[cy][cx] != CellType::Empty) continue;
+
+			uint16_t best = Unreachable;
+			if (IsSource(Target, Grid, Items, cx, cy))
+			{
+				best = 0;
+			}
+			else
+			{
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					const int nx = cx + DX[dir];
+					const int ny = cy + DY[dir];
+					if (!InBounds(nx, ny)) continue;
+					const uint16_t d = field[ny * W + nx];
+					if (d != Unreachable && d + 1 < best)
+						best = d + 1;
+				}
+			}
+			if (best != Unreachable)
+			{
+				field[cell] = best;
+				open.push({best, cell});
+			}
+		}
+
+		// 3. Propagate (unit weights, seeds at different distances)
+		while (!open.empty())
+		{
+			const FEntry entry = open.top();
+			open.pop();
+			if (entry.first != field[entry.second]) continue;
+			const int cx = entry.second % W;
+			const int cy = entry.second / W;
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int nx = cx + DX[dir];
+				const int ny = cy + DY[dir];
+				if (!InBounds(nx, ny) || Grid[ny][nx] != CellType::Empty) continue;
+				const int next = ny * W + nx;
+				if (entry.first + 1 < field[next])
+				{
+					field[next] = entry.first + 1;
+					open.push({field[next], next});
+				}
+			}
+		}
+	}
+};
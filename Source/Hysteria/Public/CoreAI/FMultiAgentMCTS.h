@@ -4,30 +4,95 @@
 
 #include "WorldState.h"
 #include "SearchTree.h"
+#include "JointSearchTree.h"
 #include "Types.h"
 #include "SimulationContext.h"
+#include "AgentLOD.h"
+#include "OpeningBook.h"
+#include "Cancellation.h"
+#include "WorldEdit.h"
+#include "WorldSnapshot.h"
 #include <array>
+#include <atomic>
 #include <optional>
+#ifdef HYSTERIA_USE_UNREAL
+#include "Async/Async.h"
+#include "Templates/Function.h"
+#else
+#include <functional>
+#include <future>
+#endif
 
-template <int W, int H, int N_AGENTS>
+// Per-step search metrics
+template <int N_AGENTS>
+struct FPlannerStepStats
+{
+	// Rollouts in each agent's current tree; a mid-turn edit that rebuilds or reweights the
+	// tree starts its count again. TotalRollouts counts every rollout of the step.
+	std::array<int, N_AGENTS> RolloutsPerAgent = {};
+	int TotalRollouts = 0;
+	// What a uniform totalRollouts-per-agent allocation would have spent
+	int UniformRollouts = 0;
+	int Rounds = 0;
+	double SearchSeconds = 0.0;
+	double LatencySavedSeconds = 0.0;
+	// Size of each agent's tree at the end of the search
+	std::array<FTreeMemoryStats, N_AGENTS> TreeMemory = {};
+	// Whose root statistics came from the opening book
+	std::array<bool, N_AGENTS> SeededFromBook = {};
+	// Leaf cache lookups of this step
+	FLeafCacheStats LeafCache;
+	// Rollouts pondered into each agent's tree before the step; RolloutsPerAgent excludes them
+	std::array<int, N_AGENTS> PonderedRollouts = {};
+	// The search was cut short by CancelSearch, and how long its workers took to stop
+	bool bCancelled = false;
+	double CancelLatencySeconds = 0.0;
+};
+
+// What a world edit did to an agent's tree
+enum class ETreeInvalidation : uint8_t
+{
+	// Out of reach of the search, moved onto the edited world as it is
+	Kept,
+	// Within the search horizon, statistics kept as a down-weighted prior
+	Reweighted,
+	// Next to the agent or in a mode where every plan may change, searched from scratch
+	Rebuilt
+};
+
+template <int W, int H, int N_AGENTS, typename TLeafEvaluator = FRandomPlayoutEvaluator<W, H, N_AGENTS>>
 class FMultiAgentMCTS
 {
 public:
 	using FWorldState = WorldState<W, H, N_AGENTS>;
 	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FTree = FMCTS<W, H, N_AGENTS, TLeafEvaluator>;
+	using FJointSearch = FJointMCTS<W, H, N_AGENTS, TLeafEvaluator>;
+	using FJointAction = std::array<FAgentAction, N_AGENTS>;
+	using FWorldSnapshotPtr = typename FWorldSnapshotPublisher<W, H, N_AGENTS>::FSnapshotPtr;
+#ifdef HYSTERIA_USE_UNREAL
+	using FStepCallback = TFunction<void(const FJointAction&)>;
+#else
+	using FStepCallback = std::function<void(const FJointAction&)>;
+#endif
 
 	explicit FMultiAgentMCTS(const FWorldState& InitialState)
 		: SimulationContext(), CurrentState(InitialState)		  
 	{
 		CurrentState = InitialState;
+		// The initial grid may have been written directly
+		CurrentState.RebuildMoveTables();
+		// The first snapshot lists everything, and the first publish builds the distance fields
+		CurrentState.MarkAllChanged();
 
 		SimulationContext = FSimContext();
 		SimulationContext.GlobalTurn = InitialState.turnCounter;
 
 		for (int i = 0; i < N_AGENTS; ++i)
 		{
-			AgentTrees[i] = FMCTS<W, H, N_AGENTS>(InitialState, i);
+			ResetTree(i);
 		}
+		PublishWorld();
 	}
 
 	FAgentAction GetPlannedActionForAgent(int Agent)
@@ -42,49 +107,974 @@ public:
 	//Performs a single step of the MCTS process for all agents.
 	std::array<FAgentAction, N_AGENTS> Step()
 	{
+		HYSTERIA_TRACE_SCOPE("Planner.Step");
+		BeginTurn();
+		const double SearchStart = HysteriaNowSeconds();
 
-		std::array<int, N_AGENTS> agentOrder;
+		if (bJointSearch)
+		{
+			// One shared simulation updates every searched agent's tree
+			const int done = FJointSearch(AgentTrees, CurrentState, JointSimulationContext, SearchedAgents, Evaluator)
+				.RunSearch(numThreads, totalRollouts, &SearchCancel);
+			AddJointRollouts(done);
+		}
+		else if (bAdaptiveBudget)
+		{
+			RunAdaptiveSearch();
+		}
+		else
+		{
+			for (int i = 0; i < N_AGENTS; ++i)
+			{
+				// Rollouts already pondered into the tree count towards this step's share
+				const int rollouts = GetRemainingRollouts(i);
+				if (rollouts <= 0 || SearchCancel.IsCancelled()) continue;
+				const int done = AgentTrees[i].RunSearch(numThreads, rollouts, SimulationContext, &SearchCancel);
+				LastStepStats.RolloutsPerAgent[i] += done;
+				LastStepStats.TotalRollouts += done;
+			}
+		}
+
+		TurnSearchSeconds += HysteriaNowSeconds() - SearchStart;
+		if (SearchCancel.IsCancelled())
+		{
+			LastStepStats.bCancelled = true;
+			LastStepStats.CancelLatencySeconds = SearchCancel.GetSecondsSinceCancel();
+		}
+		return CommitTurn();
+	}
 
+	// Time-sliced alternative to Step for callers that cannot spare a thread: BeginTurn, then
+	// AdvanceTurn in bounded slices (e.g. once per tick) until it returns true, then CommitTurn.
+	// Everything runs on the calling thread and the trees keep their state between slices.
+	// Leave pondering off, it needs a thread of its own.
+	void BeginTurn()
+	{
+		HYSTERIA_TRACE_SCOPE("Planner.BeginTurn");
+		// A cancel that came in after the last turn committed is not meant for this one
+		SearchCancel.Reset();
+		// Pondered trees are kept only if nobody edited the world they were searching
+		StopPondering();
+		ApplyQueuedEdits();
+		bool bPondered = false;
 		for (int i = 0; i < N_AGENTS; ++i)
-			agentOrder[i] = i;
+			bPondered |= PonderedRollouts[i] > 0;
+		if (bPondered && (PonderHash != CurrentState.Hash() || PonderTurn != CurrentState.turnCounter))
+		{
+			for (int i = 0; i < N_AGENTS; ++i)
+				ResetTree(i);
+		}
 
-		
-		std::array<FAgentAction, N_AGENTS> Actions;
+		PrepareTurnInputs();
+
+		LastStepStats = FPlannerStepStats<N_AGENTS>();
+		LastStepStats.PonderedRollouts = PonderedRollouts;
+		LastStepStats.SeededFromBook = TreeSeededFromBook;
+		TurnCacheStats = LeafCache ? LeafCache->GetStats() : FLeafCacheStats();
+		TurnSearchSeconds = 0.0;
+		bTurnInProgress = true;
+	}
+
+	// Searches at most MaxRollouts more rollouts of the turn, fewer once MaxSeconds (if > 0)
+	// have passed; the clock is checked every TurnSlice rollouts. True once the turn has its
+	// full rollout count or CancelSearch stopped it. Each slice goes to the agent furthest
+	// from its share. Adaptive budgets are searched uniformly here. Edits queued since the
+	// last slice are applied first.
+	bool AdvanceTurn(int MaxRollouts, double MaxSeconds = 0.0)
+	{
+		HYSTERIA_TRACE_SCOPE("Planner.AdvanceTurn");
+		if (!bTurnInProgress)
+			BeginTurn();
+		else if (ApplyQueuedEdits() > 0)
+			PrepareTurnInputs();
+
+		const double Start = HysteriaNowSeconds();
+		int done = 0;
+		while (done < MaxRollouts)
+		{
+			if (MaxSeconds > 0.0 && HysteriaNowSeconds() - Start >= MaxSeconds) break;
+			const int slice = std::min(TurnSlice, MaxRollouts - done);
 
+			if (SearchCancel.IsCancelled()) break;
+
+			if (bJointSearch)
+			{
+				// Every joint rollout counts for each searched agent
+				int remaining = 0;
+				for (int i = 0; i < N_AGENTS; ++i)
+					remaining = std::max(remaining, GetRemainingRollouts(i));
+				if (remaining <= 0) break;
+				const int rollouts = FJointSearch(AgentTrees, CurrentState, JointSimulationContext, SearchedAgents, Evaluator)
+					.RunSearchSlice(std::min(slice, remaining), &SearchCancel);
+				AddJointRollouts(rollouts);
+				done += rollouts;
+				continue;
+			}
+
+			int agent = -1;
+			int remaining = 0;
+			for (int i = 0; i < N_AGENTS; ++i)
+			{
+				if (GetRemainingRollouts(i) > remaining)
+				{
+					agent = i;
+					remaining = GetRemainingRollouts(i);
+				}
+			}
+			if (agent < 0) break;
+
+			const int rollouts = AgentTrees[agent].RunSearchSlice(std::min(slice, remaining), SimulationContext, &SearchCancel);
+			LastStepStats.RolloutsPerAgent[agent] += rollouts;
+			LastStepStats.TotalRollouts += rollouts;
+			done += rollouts;
+		}
+
+		TurnSearchSeconds += HysteriaNowSeconds() - Start;
+		return IsTurnSearchComplete();
+	}
+
+	// Also true once CancelSearch stopped the turn; it then commits what it has
+	bool IsTurnSearchComplete() const
+	{
+		if (SearchCancel.IsCancelled()) return true;
 		for (int i = 0; i < N_AGENTS; ++i)
 		{
-			int AgentIndex = agentOrder[i];
-			auto& tree = AgentTrees[AgentIndex];
-			tree.RunSearch(numThreads, totalRollouts, SimulationContext);
-			Actions[AgentIndex] = tree.GetBestAction();
+			if (GetRemainingRollouts(i) > 0) return false;
+		}
+		return true;
+	}
+
+	// What CommitTurn would play right now
+	FJointAction GetBestActionsSoFar() const
+	{
+		FJointAction Actions;
+		for (int i = 0; i < N_AGENTS; ++i)
+			Actions[i] = SearchedAgents[i] ? AgentTrees[i].GetBestAction() : ReactiveTrajectories[i][0];
+		return Actions;
+	}
+
+	// Plays the best actions found so far, whether or not the turn's search is complete, and
+	// starts the next turn's trees
+	FJointAction CommitTurn()
+	{
+		HYSTERIA_TRACE_SCOPE("Planner.CommitTurn");
+		if (!bTurnInProgress)
+			BeginTurn();
+		bTurnInProgress = false;
+
+		const FJointAction Actions = GetBestActionsSoFar();
+
+		LastStepStats.SearchSeconds = TurnSearchSeconds;
+		if (LeafCache)
+			LastStepStats.LeafCache = LeafCache->GetStats().Since(TurnCacheStats);
+
+		if (BookRecorder)
+		{
+			for (int i = 0; i < N_AGENTS; ++i)
+				if (SearchedAgents[i])
+					BookRecorder->Record(TurnRootHash, i, AgentTrees[i].GetRootStats());
 		}
 
 		// Apply joint actions to world
-		CurrentState.NextState(Actions);
+		const uint8_t RootTurn = CurrentState.turnCounter;
+		{
+			HYSTERIA_TRACE_SCOPE("World.NextState");
+			CurrentState.NextState(Actions);
+
+			// Edits queued during the search apply to the world it produced; the trees are rebuilt below
+			HYSTERIA_VECTOR<FWorldEdit> Edits;
+			EditQueue.Drain(Edits);
+			for (const FWorldEdit& Edit : Edits)
+				Edit.ApplyTo(CurrentState);
+		}
 
-		// Extract the best trajectory for each action
+		// Extract the best trajectory for each action and publish them as one immutable snapshot
+		FTrajectorySet<N_AGENTS> Trajectories;
 		for (int i = 0; i < N_AGENTS; ++i)
 		{
-			auto& tree = AgentTrees[i];
-			SimulationContext.SetTrajectory(i, tree.GetBestTrajectory());
+			if (SearchedAgents[i])
+				Trajectories[i] = AgentTrees[i].GetBestTrajectory();
+			else
+				Trajectories[i] = std::move(ReactiveTrajectories[i]);
 		}
+		SimulationContext.PublishTrajectories(std::move(Trajectories), RootTurn);
+		PublishWorld();
+
+		for (int i = 0; i < N_AGENTS; ++i)
+			LastStepStats.TreeMemory[i] = AgentTrees[i].GetMemoryStats();
 		
 		// Reset each agent's tree to the new state
 		for (int i = 0; i < N_AGENTS; ++i)
 		{
-			AgentTrees[i] = FMCTS<W, H, N_AGENTS>(CurrentState, i);
+			if (HistoryTables[i])
+				HistoryTables[i]->Decay();
+			ResetTree(i);
 		}
+
+		if (bPondering)
+			StartPondering();
 		
 		return Actions;
 	}
+
+	// Runs Step on a planning thread of its own and returns at once; false if a step is still
+	// running. OnComplete is called on the planning thread with the joint actions, before the
+	// step counts as finished, so it must not start the next step itself. Until then the
+	// caller must leave the planner alone: no edits, no reads of the current state.
+	bool StepAsync(FStepCallback OnComplete = nullptr)
+	{
+		if (bStepInProgress.exchange(true)) return false;
+		bAsyncResultReady = false;
+
+		auto Task = [this, OnComplete]()
+		{
+			AsyncResult = Step();
+			bAsyncResultReady = true;
+			if (OnComplete)
+				OnComplete(AsyncResult);
+			bStepInProgress = false;
+		};
+#ifdef HYSTERIA_USE_UNREAL
+		// A dedicated thread, since the rollout workers it waits for run on the thread pool
+		PendingStep = Async(EAsyncExecution::Thread, MoveTemp(Task));
+#else
+		PendingStep = std::async(std::launch::async, std::move(Task));
+#endif
+		return true;
+	}
+
+	bool IsStepInProgress() const
+	{
+		return bStepInProgress.load();
+	}
+
+	// Polling alternative to the callback: true once, with the actions of the finished async step
+	bool TryGetStepResult(FJointAction& OutActions)
+	{
+		if (bStepInProgress.load() || !bAsyncResultReady.load()) return false;
+		bAsyncResultReady = false;
+		OutActions = AsyncResult;
+		return true;
+	}
+
+	// Blocks until the running async step is done, e.g. before the planner is destroyed
+	void WaitForStep()
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		if (PendingStep.IsValid())
+			PendingStep.Wait();
+#else
+		if (PendingStep.valid())
+			PendingStep.wait();
+#endif
+	}
+
+	~FMultiAgentMCTS()
+	{
+		WaitForStep();
+		StopPondering();
+	}
+
+	// Pondering: after each step the new trees, rooted at the state the step produced, keep
+	// searching on one background thread until the next step, up to MaxRolloutsPerAgent each
+	// (0 = ten steps' worth). The next step keeps them if the world was not edited in between
+	// and only tops them up to the usual rollout count. Per-agent search only; joint search
+	// does not ponder.
+	void SetPondering(bool bEnabled, int MaxRolloutsPerAgent = 0)
+	{
+		StopPondering();
+		bPondering = bEnabled && !bJointSearch;
+		maxPonderRollouts = MaxRolloutsPerAgent;
+		if (bPondering)
+			StartPondering();
+	}
+
+	// Stops the running turn's search (Step, StepAsync, AdvanceTurn) within about one rollout
+	// per worker; the turn then commits the best actions found so far. Also stops pondering,
+	// without waiting for it. Thread-safe; does nothing between turns, including the moments of an
+	// async step before its search starts or after it committed.
+	void CancelSearch()
+	{
+		if (bTurnInProgress)
+			SearchCancel.Cancel();
+		PonderCancel.Cancel();
+	}
+
+	// Stops the background search and waits for it; true if it had been running. Call before
+	// reading or changing the trees (snapshots, planner settings) while pondering is enabled.
+	bool StopPondering()
+	{
+		PonderCancel.Cancel();
+#ifdef HYSTERIA_USE_UNREAL
+		const bool bWasRunning = PonderTask.IsValid();
+		if (bWasRunning)
+		{
+			PonderTask.Wait();
+			PonderTask = TFuture<void>();
+		}
+#else
+		const bool bWasRunning = PonderTask.valid();
+		if (bWasRunning)
+			PonderTask.get();
+#endif
+		PonderCancel.Reset();
+		return bWasRunning;
+	}
+
+	// The live world, for the planner's own thread between steps. Changes made through it are
+	// not published; prefer world edits.
 	FWorldState& GetCurrentState()
 	{
 		return CurrentState;
 	}
+
+	// The world as of the last step, edit or load. Safe from any thread, also while a step is
+	// running: the handle pins an immutable copy, so scan it rather than copy it.
+	FWorldSnapshotPtr GetWorldSnapshot() const
+	{
+		return PublishedWorld.Get();
+	}
+
+	// Applies edits to the current world and invalidates only the searches they can reach. An
+	// agent's search reaches its tree depth plus EditPlayoutHorizon cells (a lower bound on
+	// walking distance is the Manhattan distance): edits beyond that keep the tree, edits
+	// within it keep the statistics at EditReweight as a prior, and edits next to the agent,
+	// which can change its legal moves, rebuild the tree. Macro trees span the whole map and
+	// are rebuilt; in joint search every tree plays all agents, so the nearest agent counts.
+	// A moved agent's own tree is always rebuilt, and the cell it left counts as edited too.
+	// Not while a step is running; other threads use QueueWorldEdit.
+	void ApplyWorldEdits(const FWorldEdit* Edits, int Count)
+	{
+		if (Count <= 0) return;
+		HYSTERIA_TRACE_SCOPE("World.ApplyEdits");
+		const bool bWasPondering = StopPondering();
+
+		HYSTERIA_VECTOR<std::pair<int, int>> cells;
+		std::array<bool, N_AGENTS> moved = {};
+		for (int e = 0; e < Count; ++e)
+		{
+			if (Edits[e].Type == EWorldEditType::MoveAgent && Edits[e].Agent < N_AGENTS)
+			{
+				const AgentState& agent = CurrentState.agents[Edits[e].Agent];
+#ifdef HYSTERIA_USE_UNREAL
+				cells.Add(std::make_pair(static_cast<int>(agent.x), static_cast<int>(agent.y)));
+#else
+				cells.push_back(std::make_pair(static_cast<int>(agent.x), static_cast<int>(agent.y)));
+#endif
+				moved[Edits[e].Agent] = true;
+			}
+#ifdef HYSTERIA_USE_UNREAL
+			cells.Add(std::make_pair(static_cast<int>(Edits[e].X), static_cast<int>(Edits[e].Y)));
+#else
+			cells.push_back(std::make_pair(static_cast<int>(Edits[e].X), static_cast<int>(Edits[e].Y)));
+#endif
+			Edits[e].ApplyTo(CurrentState);
+		}
+
+		std::array<int, N_AGENTS> distance;
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			distance[i] = moved[i] ? 0 : W + H;
+			for (const std::pair<int, int>& cell : cells)
+			{
+				const int d = std::abs(CurrentState.agents[i].x - cell.first) + std::abs(CurrentState.agents[i].y - cell.second);
+				distance[i] = std::min(distance[i], d);
+			}
+		}
+		if (bJointSearch)
+		{
+			const int nearest = *std::min_element(distance.begin(), distance.end());
+			distance.fill(nearest);
+		}
+
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			if (distance[i] <= 1 || (bUseMacroActions && !bJointSearch))
+			{
+				ResetTree(i);
+				LastEditInvalidation[i] = ETreeInvalidation::Rebuilt;
+			}
+			else if (distance[i] <= AgentTrees[i].GetDepth() + EditPlayoutHorizon)
+			{
+				AgentTrees[i].Rebase(CurrentState, EditReweight);
+				PonderedRollouts[i] = 0;
+				LastEditInvalidation[i] = ETreeInvalidation::Reweighted;
+			}
+			else
+			{
+				AgentTrees[i].Rebase(CurrentState);
+				LastEditInvalidation[i] = ETreeInvalidation::Kept;
+			}
+			// Mid-turn, a rebuilt or reweighted tree has none of this turn's visits left and
+			// gets its full share again (see GetRemainingRollouts)
+			if (bTurnInProgress && LastEditInvalidation[i] != ETreeInvalidation::Kept)
+				LastStepStats.RolloutsPerAgent[i] = 0;
+		}
+
+		PublishWorld();
+
+		// The trees now match the edited world, so pondered work on them stays valid
+		PonderHash = CurrentState.Hash();
+		if (bWasPondering && bPondering)
+			StartPondering();
+	}
+
+	void ApplyWorldEdit(const FWorldEdit& Edit)
+	{
+		ApplyWorldEdits(&Edit, 1);
+	}
+
+	const std::array<ETreeInvalidation, N_AGENTS>& GetLastEditInvalidation() const
+	{
+		return LastEditInvalidation;
+	}
+
+	// Queues an edit from any thread, without waiting for the planner. Queued edits apply at
+	// the next safe point: the start or end of a turn, between the slices of a time-sliced
+	// turn, or ApplyQueuedEdits. A burst is applied as one batch, with only the last edit
+	// per cell and layer (or per moved agent), so it invalidates the trees once.
+	void QueueWorldEdit(const FWorldEdit& Edit)
+	{
+		EditQueue.Push(Edit);
+	}
+
+	void QueueWorldEdits(const FWorldEdit* Edits, int Count)
+	{
+		for (int e = 0; e < Count; ++e)
+			EditQueue.Push(Edits[e]);
+	}
+
+	bool HasQueuedEdits() const
+	{
+		return !EditQueue.IsEmpty();
+	}
+
+	// Applies the queued edits now, like ApplyWorldEdits; returns how many were queued. On the
+	// planner's own thread, not while a step is running.
+	int ApplyQueuedEdits()
+	{
+		HYSTERIA_VECTOR<FWorldEdit> Edits;
+		const int queued = EditQueue.Drain(Edits);
+#ifdef HYSTERIA_USE_UNREAL
+		ApplyWorldEdits(Edits.GetData(), Edits.Num());
+#else
+		ApplyWorldEdits(Edits.data(), static_cast<int>(Edits.size()));
+#endif
+		return queued;
+	}
+
+	// Limits how many agents get a full tree search per step. The others use FReactivePolicy,
+	// so the search cost per turn stays bounded regardless of crowd size.
+	void SetSearchAgentBudget(int Budget)
+	{
+		searchAgentBudget = Budget;
+	}
+
+	// Joint mode runs totalRollouts shared playouts per step that update all searched agents
+	// at once, instead of totalRollouts separate rollouts per agent. The agent budget still
+	// applies: the other agents follow their reactive trajectories inside the playouts.
+	void SetJointSearch(bool bEnabled)
+	{
+		bJointSearch = bEnabled;
+		bPondering = bPondering && !bJointSearch;
+		for (int i = 0; i < N_AGENTS; ++i)
+			ResetTree(i);
+	}
+
+	// Hands out a global per-step budget in rounds to agents whose root decision is still
+	// contested, instead of giving every agent totalRollouts. A TimeBudgetSeconds > 0 also
+	// caps the search time of a step.
+	void SetAdaptiveBudget(bool bEnabled, int MinRolloutsPerAgent = 200, int RolloutsPerRound = 200,
+	                       double TimeBudgetSeconds = 0.0)
+	{
+		bAdaptiveBudget = bEnabled;
+		adaptiveMinRollouts = MinRolloutsPerAgent;
+		adaptiveRoundRollouts = RolloutsPerRound;
+		stepTimeBudgetSeconds = TimeBudgetSeconds;
+	}
+
+	const FPlannerStepStats<N_AGENTS>& GetLastStepStats() const
+	{
+		return LastStepStats;
+	}
+
+	// Configures the leaf evaluator (e.g. loaded model weights) used by trees created from now on
+	void SetLeafEvaluator(const TLeafEvaluator& InEvaluator)
+	{
+		Evaluator = InEvaluator;
+		for (int i = 0; i < N_AGENTS; ++i)
+			ResetTree(i);
+	}
+
+	// Search over go-to-target macros instead of single moves (not used by joint search)
+	void SetUseMacroActions(bool bEnabled)
+	{
+		bUseMacroActions = bEnabled;
+		for (int i = 0; i < N_AGENTS; ++i)
+			ResetTree(i);
+	}
+
+	// Macro search over regions (FRegionMap) for big maps: cell-level macros only look
+	// FRegionMap::LocalHorizon cells around the agent, farther goals are reached region by region.
+	// Only has an effect together with SetUseMacroActions.
+	void SetUseRegionAbstraction(bool bEnabled)
+	{
+		// The ponder thread copies the simulation context for every slice
+		StopPondering();
+		bUseRegionAbstraction = bEnabled;
+		SimulationContext.Regions = nullptr;
+	}
+
+	// Rollouts each searched agent gets per step (the global budget in adaptive mode is this
+	// times the number of searched agents)
+	void SetRolloutsPerAgent(int Rollouts)
+	{
+		totalRollouts = Rollouts;
+	}
+
+	// New trees whose root position is in the book start from its root statistics
+	void SetOpeningBook(const HYSTERIA_SHARED_PTR<const FOpeningBook<W, H, N_AGENTS>>& Book)
+	{
+		OpeningBook = Book;
+		for (int i = 0; i < N_AGENTS; ++i)
+			ResetTree(i);
+	}
+
+	// Every step stores the root statistics of the searched agents in Book (nullptr stops)
+	void SetOpeningBookRecorder(FOpeningBook<W, H, N_AGENTS>* Book)
+	{
+		BookRecorder = Book;
+	}
+
+	// Node budget for each agent's tree and for all trees together (0 = unbounded). The
+	// planner budget is split evenly, each tree gets the smaller of both shares.
+	void SetNodeBudget(int PerTree, int PerPlanner = 0)
+	{
+		StopPondering();
+		nodeBudgetPerTree = PerTree;
+		nodeBudgetPerPlanner = PerPlanner;
+		for (int i = 0; i < N_AGENTS; ++i)
+			AgentTrees[i].SetNodeBudget(GetTreeNodeBudget());
+	}
+
+	// Per-agent history heuristic: new children are ordered and primed by how their action did
+	// in the same local situation in earlier steps. Applies to primitive-action trees, macro
+	// children keep their fixed order.
+	void SetUseHistoryHeuristic(bool bEnabled)
+	{
+		StopPondering();
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			HistoryTables[i] = nullptr;
+			if (bEnabled)
+				HistoryTables[i] = HYSTERIA_MAKE_SHARED<FHistoryTable<W, H, N_AGENTS>>();
+			AgentTrees[i].SetHistoryTable(HistoryTables[i]);
+		}
+	}
+
+	// Leaf evaluation cache with room for Entries positions, shared by all agents' trees and
+	// kept across steps (0 = evaluate every leaf). A position is served from the cache once it
+	// has MinSamples evaluations; random playouts want several, deterministic evaluators one.
+	// Joint search scores all agents at once and does not use it.
+	void SetLeafCache(int Entries, int MinSamples = 4)
+	{
+		StopPondering();
+		LeafCache = nullptr;
+		if (Entries > 0)
+			LeafCache = HYSTERIA_MAKE_SHARED<FLeafEvalCache>(Entries, MinSamples);
+		for (int i = 0; i < N_AGENTS; ++i)
+			AgentTrees[i].SetLeafCache(LeafCache);
+	}
+
+	// Cumulative hits and evaluations since SetLeafCache; GetLastStepStats().LeafCache has one step
+	FLeafCacheStats GetLeafCacheStats() const
+	{
+		return LeafCache ? LeafCache->GetStats() : FLeafCacheStats();
+	}
+
+	// Current size of an agent's tree; GetLastStepStats().TreeMemory has it at the end of a search
+	FTreeMemoryStats GetTreeMemoryStats(int Agent) const
+	{
+		return AgentTrees[Agent].GetMemoryStats();
+	}
+
+	size_t GetTotalTreeBytes() const
+	{
+		size_t bytes = 0;
+		for (int i = 0; i < N_AGENTS; ++i)
+			bytes += AgentTrees[i].GetMemoryStats().Bytes;
+		return bytes;
+	}
+
+	// Writes CurrentState, the published trajectories and every agent's tree to Path. With
+	// TopKNodes > 0 each tree keeps only about its TopKNodes most visited nodes. Each turn's
+	// commit starts fresh trees for the next turn, so between turns they hold only what the
+	// opening book and pondering put there; mid-turn (after AdvanceTurn) they hold the search.
+	bool SaveSnapshot(const HYSTERIA_STRING& Path, int TopKNodes = 0) const
+	{
+		FBinaryWriter Writer;
+		Writer.Write(SnapshotMagic);
+		Writer.Write(SnapshotVersion);
+		Writer.Write(static_cast<int32_t>(W));
+		Writer.Write(static_cast<int32_t>(H));
+		Writer.Write(static_cast<int32_t>(N_AGENTS));
+		CurrentState.Save(Writer);
+
+		Writer.Write(SimulationContext.GlobalTurn);
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			const bool bHasTrajectories = static_cast<bool>(SimulationContext.AgentTrajectories);
+#ifdef HYSTERIA_USE_UNREAL
+			const int32_t length = bHasTrajectories ? (*SimulationContext.AgentTrajectories)[i].Num() : 0;
+#else
+			const int32_t length = bHasTrajectories ? static_cast<int32_t>((*SimulationContext.AgentTrajectories)[i].size()) : 0;
+#endif
+			Writer.Write(length);
+			for (int32_t t = 0; t < length; ++t)
+				Writer.Write(static_cast<uint8_t>((*SimulationContext.AgentTrajectories)[i][t].Type));
+		}
+
+		for (int i = 0; i < N_AGENTS; ++i)
+			AgentTrees[i].Save(Writer, TopKNodes);
+		return Writer.SaveToFile(Path);
+	}
+
+	// Restores a snapshot written by SaveSnapshot for the same map size and agent count. The
+	// file is memory-mapped and read in place; the planner is left unchanged if it is invalid.
+	bool LoadSnapshot(const HYSTERIA_STRING& Path)
+	{
+		StopPondering();
+		FMappedFile File;
+		if (!File.Open(Path)) return false;
+		FBinaryReader Reader(File.GetData(), File.GetSize());
+
+		uint32_t magic = 0, version = 0;
+		int32_t width = 0, height = 0, numAgents = 0;
+		Reader.Read(magic);
+		Reader.Read(version);
+		Reader.Read(width);
+		Reader.Read(height);
+		Reader.Read(numAgents);
+		if (Reader.HasFailed() || magic != SnapshotMagic || version != SnapshotVersion ||
+			width != W || height != H || numAgents != N_AGENTS)
+			return false;
+
+		FWorldState LoadedState;
+		if (!LoadedState.Load(Reader)) return false;
+
+		uint8_t globalTurn = 0;
+		FTrajectorySet<N_AGENTS> Trajectories;
+		Reader.Read(globalTurn);
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			int32_t length = 0;
+			if (!Reader.Read(length) || length < 0) return false;
+			for (int32_t t = 0; t < length; ++t)
+			{
+				uint8_t type = 0;
+				if (!Reader.Read(type) || type > static_cast<uint8_t>(EActionType::Wait)) return false;
+#ifdef HYSTERIA_USE_UNREAL
+				Trajectories[i].Add(FAgentAction(static_cast<EActionType>(type)));
+#else
+				Trajectories[i].push_back(FAgentAction(static_cast<EActionType>(type)));
+#endif
+			}
+		}
+
+		std::array<FTree, N_AGENTS> LoadedTrees;
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			LoadedTrees[i] = FTree(LoadedState, i, Evaluator);
+			if (!LoadedTrees[i].Load(Reader)) return false;
+			LoadedTrees[i].SetNodeBudget(GetTreeNodeBudget());
+			LoadedTrees[i].SetLeafCache(LeafCache);
+			LoadedTrees[i].SetHistoryTable(HistoryTables[i]);
+		}
+
+		CurrentState = LoadedState;
+		SimulationContext.PublishTrajectories(std::move(Trajectories), globalTurn);
+		AgentTrees = std::move(LoadedTrees);
+		PublishWorld();
+		return true;
+	}
+
+	// Which agents were planned with tree search in the last step
+	const std::array<bool, N_AGENTS>& GetSearchedAgents() const
+	{
+		return SearchedAgents;
+	}
+
+	// Distance fields of the current world; not while a step is running
+	const FDistanceFieldCache<W, H>& GetDistanceFields() const
+	{
+		return DistanceFields;
+	}
 private:
-	std::array<FMCTS<W, H, N_AGENTS>, N_AGENTS> AgentTrees;
+	std::array<FTree, N_AGENTS> AgentTrees;
+	TLeafEvaluator Evaluator;
+	// Distance fields of CurrentState, repaired from its changes each time it is published
+	FDistanceFieldCache<W, H> DistanceFields;
+	// Rebuilt only when the wall layout changes
+	FRegionMap<W, H> Regions;
 	FSimContext SimulationContext;
+	// SimulationContext with only the reactive agents' trajectories of the turn, for joint search
+	FSimContext JointSimulationContext;
 	FWorldState CurrentState;
+	FWorldSnapshotPublisher<W, H, N_AGENTS> PublishedWorld;
 	int numThreads = 4;
 	int totalRollouts = 1000;
+	int searchAgentBudget = N_AGENTS;
+	int reactiveTrajectoryLength = 10;
+	bool bJointSearch = false;
+	bool bUseMacroActions = false;
+	bool bUseRegionAbstraction = false;
+	bool bAdaptiveBudget = false;
+	int adaptiveMinRollouts = 200;
+	int adaptiveRoundRollouts = 200;
+	// Root decisions with a larger visit share gap or value gap count as settled
+	double settledVisitGap = 0.5;
+	double settledValueGap = 0.25;
+	double stepTimeBudgetSeconds = 0.0;
+	int nodeBudgetPerTree = 0;
+	int nodeBudgetPerPlanner = 0;
+	HYSTERIA_SHARED_PTR<const FOpeningBook<W, H, N_AGENTS>> OpeningBook;
+	HYSTERIA_SHARED_PTR<FLeafEvalCache> LeafCache;
+	std::array<HYSTERIA_SHARED_PTR<FHistoryTable<W, H, N_AGENTS>>, N_AGENTS> HistoryTables;
+#ifdef HYSTERIA_USE_UNREAL
+	TFuture<void> PendingStep;
+#else
+	std::future<void> PendingStep;
+#endif
+	bool bPondering = false;
+	int maxPonderRollouts = 0;
+	static constexpr int PonderSlice = 32;
+	FCancellationToken PonderCancel;
+	std::array<bool, N_AGENTS> PonderAgents = {};
+	std::array<int, N_AGENTS> PonderedRollouts = {};
+	uint64_t PonderHash = 0;
+	uint8_t PonderTurn = 0;
+#ifdef HYSTERIA_USE_UNREAL
+	TFuture<void> PonderTask;
+#else
+	std::future<void> PonderTask;
+#endif
+	std::array<ETreeInvalidation, N_AGENTS> LastEditInvalidation = {};
+	// Plies a leaf evaluation looks beyond the tree, the default random playout length
+	static constexpr int EditPlayoutHorizon = 10;
+	static constexpr double EditReweight = 0.5;
+	FWorldEditQueue EditQueue;
+	// Turn in progress between BeginTurn and CommitTurn
+	std::atomic<bool> bTurnInProgress{false};
+	FCancellationToken SearchCancel;
+	static constexpr int TurnSlice = 16;
+	std::array<HYSTERIA_VECTOR<FAgentAction>, N_AGENTS> ReactiveTrajectories;
+	uint64_t TurnRootHash = 0;
+	FLeafCacheStats TurnCacheStats;
+	double TurnSearchSeconds = 0.0;
+	std::atomic<bool> bStepInProgress{false};
+	std::atomic<bool> bAsyncResultReady{false};
+	FJointAction AsyncResult = {};
+	FOpeningBook<W, H, N_AGENTS>* BookRecorder = nullptr;
+	std::array<bool, N_AGENTS> TreeSeededFromBook = {};
+	FPlannerStepStats<N_AGENTS> LastStepStats;
+	static constexpr uint32_t SnapshotMagic = 0x50535948; // "HYSP"
+	static constexpr uint32_t SnapshotVersion = 1;
+
+	// Fresh tree for Agent rooted at CurrentState
+	void ResetTree(int Agent)
+	{
+		StopPondering();
+		PonderedRollouts[Agent] = 0;
+		AgentTrees[Agent] = FTree(CurrentState, Agent, Evaluator);
+		AgentTrees[Agent].SetUseMacroActions(bUseMacroActions && !bJointSearch);
+		AgentTrees[Agent].SetNodeBudget(GetTreeNodeBudget());
+		AgentTrees[Agent].SetLeafCache(LeafCache);
+		AgentTrees[Agent].SetHistoryTable(HistoryTables[Agent]);
+
+		TreeSeededFromBook[Agent] = false;
+		if (OpeningBook)
+		{
+			const FBookEntry<N_AGENTS>* entry = OpeningBook->Find(CurrentState.Hash());
+			if (entry)
+				TreeSeededFromBook[Agent] = AgentTrees[Agent].SeedRoot((*entry)[Agent]);
+		}
+	}
+
+	// Picks the turn's searched agents and plans the others reactively from CurrentState
+	void PrepareTurnInputs()
+	{
+		// Only the most important agents get a full tree search, the rest act reactively
+		SearchedAgents = FAgentImportance<W, H, N_AGENTS>::SelectSearchAgents(CurrentState, searchAgentBudget);
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			if (SearchedAgents[i])
+				continue;
+			ReactiveTrajectories[i] = FReactivePolicy<W, H, N_AGENTS>::PlanTrajectory(
+				CurrentState, i, reactiveTrajectoryLength, &DistanceFields);
+		}
+
+		PublishSearchInputs();
+		if (bJointSearch)
+		{
+			// Joint rollouts play the reactive agents along this turn's trajectories
+			FTrajectorySet<N_AGENTS> Trajectories;
+			for (int i = 0; i < N_AGENTS; ++i)
+				if (!SearchedAgents[i])
+					Trajectories[i] = ReactiveTrajectories[i];
+			JointSimulationContext = SimulationContext;
+			JointSimulationContext.PublishTrajectories(std::move(Trajectories), CurrentState.turnCounter);
+		}
+		TurnRootHash = BookRecorder ? CurrentState.Hash() : 0;
+	}
+
+	// Publishes CurrentState with what changed since the last publish. Every write to
+	// CurrentState (construction, edits, a committed turn, a loaded snapshot) ends here.
+	void PublishWorld()
+	{
+		HYSTERIA_TRACE_SCOPE("World.Publish");
+		FWorldChangeSet Changes;
+		CurrentState.GetChanges(Changes);
+		CurrentState.ClearChanges();
+		UpdateDistanceFields(Changes);
+		PublishedWorld.Publish(CurrentState, std::move(Changes));
+	}
+
+	// Repairs the fields around the written cells; a whole new map is cheaper to rebuild
+	void UpdateDistanceFields(const FWorldChangeSet& Changes)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		const int numCells = Changes.Cells.Num();
+#else
+		const int numCells = static_cast<int>(Changes.Cells.size());
+#endif
+		if (numCells == 0) return;
+		if (numCells * 4 >= W * H)
+		{
+			DistanceFields.Rebuild(CurrentState.grid, CurrentState.items);
+			return;
+		}
+		int cells[W * H];
+		for (int i = 0; i < numCells; ++i)
+			cells[i] = Changes.Cells[i].Y * W + Changes.Cells[i].X;
+		DistanceFields.OnCellsChanged(CurrentState.grid, CurrentState.items, cells, numCells);
+	}
+
+	// Rollouts read distances from a snapshot of the live fields, which edits may have changed
+	void PublishSearchInputs()
+	{
+		SimulationContext.PublishDistanceFields(DistanceFields);
+		if (bUseRegionAbstraction)
+		{
+			Regions.RebuildIfWallsChanged(CurrentState.grid);
+			Regions.UpdateValues(CurrentState.grid, CurrentState.items);
+			SimulationContext.PublishRegions(Regions);
+		}
+	}
+
+	void StartPondering()
+	{
+		PonderHash = CurrentState.Hash();
+		PonderTurn = CurrentState.turnCounter;
+		PonderAgents = FAgentImportance<W, H, N_AGENTS>::SelectSearchAgents(CurrentState, searchAgentBudget);
+		PublishSearchInputs();
+
+		const int limit = maxPonderRollouts > 0 ? maxPonderRollouts : 10 * totalRollouts;
+		auto Task = [this, limit]()
+		{
+			HYSTERIA_TRACE_SCOPE("Planner.Ponder");
+			bool bSearched = true;
+			while (bSearched && !PonderCancel.IsCancelled())
+			{
+				// Round-robin slices share the thread fairly; a stop is seen within one rollout
+				bSearched = false;
+				for (int i = 0; i < N_AGENTS && !PonderCancel.IsCancelled(); ++i)
+				{
+					if (!PonderAgents[i] || PonderedRollouts[i] >= limit) continue;
+					PonderedRollouts[i] += AgentTrees[i].RunSearchSlice(PonderSlice, SimulationContext, &PonderCancel);
+					bSearched = true;
+				}
+			}
+		};
+#ifdef HYSTERIA_USE_UNREAL
+		PonderTask = Async(EAsyncExecution::Thread, MoveTemp(Task));
+#else
+		PonderTask = std::async(std::launch::async, std::move(Task));
+#endif
+	}
+
+	void AddJointRollouts(int Rollouts)
+	{
+		for (int i = 0; i < N_AGENTS; ++i)
+			if (SearchedAgents[i])
+				LastStepStats.RolloutsPerAgent[i] += Rollouts;
+		LastStepStats.TotalRollouts += Rollouts;
+	}
+
+	// Rollouts Agent still gets this turn
+	int GetRemainingRollouts(int Agent) const
+	{
+		if (!SearchedAgents[Agent]) return 0;
+		return totalRollouts - PonderedRollouts[Agent] - LastStepStats.RolloutsPerAgent[Agent];
+	}
+
+	int GetTreeNodeBudget() const
+	{
+		const int plannerShare = nodeBudgetPerPlanner / N_AGENTS;
+		if (nodeBudgetPerTree <= 0) return plannerShare;
+		if (plannerShare <= 0) return nodeBudgetPerTree;
+		return std::min(nodeBudgetPerTree, plannerShare);
+	}
+
+	void RunAdaptiveSearch()
+	{
+		const double Start = HysteriaNowSeconds();
+		int NumSearched = 0;
+		for (int i = 0; i < N_AGENTS; ++i)
+			NumSearched += SearchedAgents[i] ? 1 : 0;
+
+		const int GlobalBudget = totalRollouts * NumSearched;
+		int Spent = 0;
+		auto SearchAgent = [&](int Agent, int Rollouts)
+		{
+			Rollouts = std::min(Rollouts, GlobalBudget - Spent);
+			if (Rollouts <= 0) return;
+			const int done = AgentTrees[Agent].RunSearch(numThreads, Rollouts, SimulationContext, &SearchCancel);
+			LastStepStats.RolloutsPerAgent[Agent] += done;
+			Spent += done;
+		};
+
+		// Every agent gets the minimum, even if its move is obvious
+		for (int i = 0; i < N_AGENTS; ++i)
+			if (SearchedAgents[i])
+				SearchAgent(i, adaptiveMinRollouts);
+		LastStepStats.Rounds = 1;
+
+		// Further rounds only go to agents whose root decision is still contested
+		while (Spent < GlobalBudget && !SearchCancel.IsCancelled())
+		{
+			if (stepTimeBudgetSeconds > 0.0 && HysteriaNowSeconds() - Start >= stepTimeBudgetSeconds)
+				break;
+
+			bool bAnyContested = false;
+			for (int i = 0; i < N_AGENTS; ++i)
+			{
+				if (!SearchedAgents[i]) continue;
+				double VisitGap, ValueGap;
+				AgentTrees[i].GetRootDecisionGap(VisitGap, ValueGap);
+				if (VisitGap >= settledVisitGap || ValueGap >= settledValueGap) continue;
+
+				bAnyContested = true;
+				SearchAgent(i, adaptiveRoundRollouts);
+			}
+			if (!bAnyContested) break;
+			LastStepStats.Rounds++;
+		}
+
+		const double Elapsed = HysteriaNowSeconds() - Start;
+		LastStepStats.TotalRollouts = Spent;
+		LastStepStats.UniformRollouts = GlobalBudget;
+		if (Spent > 0)
+			LastStepStats.LatencySavedSeconds = Elapsed / Spent * (GlobalBudget - Spent);
+	}
+	std::array<bool, N_AGENTS> SearchedAgents = {};
 };
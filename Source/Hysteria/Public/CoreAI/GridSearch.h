@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+
+// Breadth-first search over walkable (CellType::Empty) cells of a world, following its move masks.
+// Agents do not block each other, so only the grid is considered.
+namespace GridSearch
+{
+	constexpr int Unreachable = -1;
+
+	// Move actions in the same order as EActionType (Down, Up, Left, Right)
+	constexpr EActionType MoveActions[4] = {
+		EActionType::MoveDown, EActionType::MoveUp, EActionType::MoveLeft, EActionType::MoveRight
+	};
+	constexpr int MoveDX[4] = {0, 0, -1, 1};
+	constexpr int MoveDY[4] = {1, -1, 0, 0};
+
+	// Finds the closest cell (x, y) satisfying IsTarget(x, y), starting from (StartX, StartY).
+	// Returns the walking distance or Unreachable. OutFirstStep is the first move on a shortest path
+	// (Wait if the start cell itself is a target).
+	template <int W, int H, int N_AGENTS, typename TPredicate>
+	int FindNearest(const WorldState<W, H, N_AGENTS>& State, int StartX, int StartY, TPredicate IsTarget,
+	                EActionType& OutFirstStep, int* OutTargetX = nullptr, int* OutTargetY = nullptr)
+	{
+		OutFirstStep = EActionType::Wait;
+		if (IsTarget(StartX, StartY))
+		{
+			if (OutTargetX) *OutTargetX = StartX;
+			if (OutTargetY) *OutTargetY = StartY;
+			return 0;
+		}
+
+		int16_t distance[H * W];
+		int8_t firstStep[H * W];
+		int16_t queue[H * W];
+		for (int i = 0; i < H * W; ++i)
+			distance[i] = -1;
+
+		int head = 0, tail = 0;
+		const int start = StartY * W + StartX;
+		distance[start] = 0;
+		firstStep[start] = -1;
+		queue[tail++] = static_cast<int16_t>(start);
+
+		while (head < tail)
+		{
+			const int cell = queue[head++];
+			const int cx = cell % W;
+			const int cy = cell / W;
+			const uint8_t moves = State.MoveMask[cy][cx];
+			for (int d = 0; d < 4; ++d)
+			{
+				if (!(moves & (1 << d))) continue;
+				const int nx = cx + MoveDX[d];
+				const int ny = cy + MoveDY[d];
+				const int next = ny * W + nx;
+				if (distance[next] >= 0) continue;
+
+				distance[next] = static_cast<int16_t>(distance[cell] + 1);
+				firstStep[next] = static_cast<int8_t>(firstStep[cell] < 0 ? d : firstStep[cell]);
+				if (IsTarget(nx, ny))
+				{
+					OutFirstStep = MoveActions[firstStep[next]];
+					if (OutTargetX) *OutTargetX = nx;
+					if (OutTargetY) *OutTargetY = ny;
+					return distance[next];
+				}
+				queue[tail++] = static_cast<int16_t>(next);
+			}
+		}
+		return Unreachable;
+	}
+
+	// BFS from one cell that remembers how every reached cell was entered, so paths to several
+	// targets can be read back from a single search. Cells are visited in distance order; cells
+	// farther than MaxDistance are left unreached.
+	template <int W, int H>
+	struct FPathTree
+	{
+		int16_t Distance[H * W];
+		int8_t EnteredBy[H * W];
+		int16_t Order[H * W];
+		int NumReached = 0;
+
+		template <int N_AGENTS>
+		void Build(const WorldState<W, H, N_AGENTS>& State, int StartX, int StartY, int MaxDistance = W * H)
+		{
+			for (int i = 0; i < H * W; ++i)
+				Distance[i] = -1;
+
+			int head = 0;
+			NumReached = 0;
+			const int start = StartY * W + StartX;
+			Distance[start] = 0;
+			EnteredBy[start] = -1;
+			Order[NumReached++] = static_cast<int16_t>(start);
+
+			while (head < NumReached)
+			{
+				const int cell = Order[head++];
+				if (Distance[cell] >= MaxDistance) break;
+				const uint8_t moves = State.MoveMask[cell / W][cell % W];
+				for (int d = 0; d < 4; ++d)
+				{
+					if (!(moves & (1 << d))) continue;
+					const int next = FMoveTable<W, H>::GetNeighbor(cell, d);
+					if (Distance[next] >= 0) continue;
+					Distance[next] = static_cast<int16_t>(Distance[cell] + 1);
+					EnteredBy[next] = static_cast<int8_t>(d);
+					Order[NumReached++] = static_cast<int16_t>(next);
+				}
+			}
+		}
+
+		// Nearest reached cell index satisfying IsTarget(x, y), -1 if none
+		template <typename TPredicate>
+		int FindNearest(TPredicate IsTarget) const
+		{
+			for (int i = 0; i < NumReached; ++i)
+			{
+				if (IsTarget(Order[i] % W, Order[i] / W))
+					return Order[i];
+			}
+			return -1;
+		}
+
+		// Moves from the start to Cell, written to OutMoves; returns the number of moves
+		int GetPath(int Cell, EActionType* OutMoves, int MaxMoves) const
+		{
+			const int length = Distance[Cell];
+			if (length < 0 || length > MaxMoves) return -1;
+			for (int i = length - 1; i >= 0; --i)
+			{
+				const int d = EnteredBy[Cell];
+				OutMoves[i] = MoveActions[d];
+				Cell = (Cell / W - MoveDY[d]) * W + Cell % W - MoveDX[d];
+			}
+			return length;
+		}
+	};
+
+	// True if any of the 4 neighbours of (X, Y) has the given cell type
+	template <int W, int H, int N_AGENTS>
+	bool HasNeighborCell(const WorldState<W, H, N_AGENTS>& State, int X, int Y, CellType Type)
+	{
+		for (int d = 0; d < 4; ++d)
+		{
+			const int nx = X + MoveDX[d];
+			const int ny = Y + MoveDY[d];
+			if (nx >= 0 && nx < W && ny >= 0 && ny < H && State.grid[ny][nx] == Type)
+				return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include "WorldChangeSet.h"
+#include <array>
+#include <cstdint>
+
+// What a view shows on a cell or for an agent; one actor class each
+enum class EGridVisual : uint8_t
+{
+	None,
+	Wall,
+	Fire,
+	Boulder,
+	Coin,
+	Hose,
+	Apple,
+	Pickaxe,
+	Agent,
+	Count
+};
+
+enum class EGridViewOpType : uint8_t
+{
+	// A new instance: create its actor at X, Y
+	Spawn,
+	// A pooled instance comes back at X, Y
+	Show,
+	// The instance goes back to its pool
+	Hide,
+	// The instance moves to X, Y
+	Move
+};
+
+struct FGridViewOp
+{
+	EGridViewOpType Type = EGridViewOpType::Spawn;
+	EGridVisual Visual = EGridVisual::None;
+	// Stable index of the instance; Spawn ops hand them out in order 0, 1, 2, ...
+	int Instance = 0;
+	uint8_t X = 0;
+	uint8_t Y = 0;
+};
+
+struct FGridViewStats
+{
+	int64_t Spawns = 0;
+	int64_t Shows = 0;
+	int64_t Hides = 0;
+	int64_t Moves = 0;
+};
+
+// Engine-free model of a grid view: which visual every cell and agent shows, and which pooled
+// instance shows it. Fed with change sets (or whole worlds), it emits the ops that bring the
+// view up to date, reusing hidden instances of a visual before spawning new ones, so the
+// cost of a refresh follows what changed rather than the map size.
+template <int W, int H, int N_AGENTS>
+class FGridView
+{
+public:
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+
+	FGridView()
+	{
+		CellInstance.fill(NoInstance);
+		CellVisual.fill(EGridVisual::None);
+		AgentInstance.fill(NoInstance);
+	}
+
+	// A tile hides the item under it
+	static EGridVisual GetCellVisual(CellType Tile, ItemType Item)
+	{
+		switch (Tile)
+		{
+		case CellType::Wall:
+			return EGridVisual::Wall;
+		case CellType::Fire:
+			return EGridVisual::Fire;
+		case CellType::PlayerObstacle:
+			return EGridVisual::Boulder;
+		default:
+			break;
+		}
+		switch (Item)
+		{
+		case ItemType::Coin:
+			return EGridVisual::Coin;
+		case ItemType::Hose:
+			return EGridVisual::Hose;
+		case ItemType::Food:
+			return EGridVisual::Apple;
+		case ItemType::Pickaxe:
+			return EGridVisual::Pickaxe;
+		default:
+			return EGridVisual::None;
+		}
+	}
+
+	// Applies the changes of one published version
+	void ApplyChanges(const FWorldChangeSet& Changes, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		for (const FCellChange& cell : Changes.Cells)
+			SetCell(cell.X, cell.Y, GetCellVisual(cell.Tile, cell.Item), OutOps);
+		for (const FAgentChange& agent : Changes.Agents)
+			SetAgent(agent.Agent, agent.State.x, agent.State.y, OutOps);
+	}
+
+	// Brings the view to State whatever it showed before, e.g. after skipped versions
+	void Sync(const FWorldState& State, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		for (int y = 0; y < H; ++y)
+			for (int x = 0; x < W; ++x)
+				SetCell(x, y, GetCellVisual(State.grid[y][x], State.items[y][x]), OutOps);
+		for (int i = 0; i < N_AGENTS; ++i)
+			SetAgent(i, State.agents[i].x, State.agents[i].y, OutOps);
+	}
+
+	EGridVisual GetVisualAt(int X, int Y) const
+	{
+		return CellVisual[Y * W + X];
+	}
+
+	// Instances created so far, shown or pooled
+	int GetNumInstances() const
+	{
+		return NumInstances;
+	}
+
+	const FGridViewStats& GetStats() const
+	{
+		return Stats;
+	}
+
+private:
+	static constexpr int NoInstance = -1;
+	static constexpr int NumVisuals = static_cast<int>(EGridVisual::Count);
+
+	std::array<int, W * H> CellInstance;
+	std::array<EGridVisual, W * H> CellVisual;
+	std::array<int, N_AGENTS> AgentInstance;
+	std::array<uint8_t, N_AGENTS> AgentX = {};
+	std::array<uint8_t, N_AGENTS> AgentY = {};
+	// Hidden instances per visual, ready for reuse
+	std::array<HYSTERIA_VECTOR<int>, NumVisuals> Pools;
+	int NumInstances = 0;
+	FGridViewStats Stats;
+
+	void SetCell(int X, int Y, EGridVisual Visual, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		const int cell = Y * W + X;
+		if (CellVisual[cell] == Visual) return;
+
+		if (CellInstance[cell] != NoInstance)
+		{
+			Release(CellVisual[cell], CellInstance[cell], OutOps);
+			CellInstance[cell] = NoInstance;
+		}
+		CellVisual[cell] = Visual;
+		if (Visual != EGridVisual::None)
+			CellInstance[cell] = Acquire(Visual, X, Y, OutOps);
+	}
+
+	void SetAgent(int Agent, int X, int Y, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		if (AgentInstance[Agent] == NoInstance)
+		{
+			AgentInstance[Agent] = Acquire(EGridVisual::Agent, X, Y, OutOps);
+		}
+		else if (AgentX[Agent] != X || AgentY[Agent] != Y)
+		{
+			Emit(EGridViewOpType::Move, EGridVisual::Agent, AgentInstance[Agent], X, Y, OutOps);
+			Stats.Moves++;
+		}
+		AgentX[Agent] = static_cast<uint8_t>(X);
+		AgentY[Agent] = static_cast<uint8_t>(Y);
+	}
+
+	int Acquire(EGridVisual Visual, int X, int Y, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		HYSTERIA_VECTOR<int>& pool = Pools[static_cast<int>(Visual)];
+#ifdef HYSTERIA_USE_UNREAL
+		const bool bPooled = pool.Num() > 0;
+#else
+		const bool bPooled = !pool.empty();
+#endif
+		if (bPooled)
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			const int instance = pool.Pop();
+#else
+			const int instance = pool.back();
+			pool.pop_back();
+#endif
+			Emit(EGridViewOpType::Show, Visual, instance, X, Y, OutOps);
+			Stats.Shows++;
+			return instance;
+		}
+		const int instance = NumInstances++;
+		Emit(EGridViewOpType::Spawn, Visual, instance, X, Y, OutOps);
+		Stats.Spawns++;
+		return instance;
+	}
+
+	void Release(EGridVisual Visual, int Instance, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		Pools[static_cast<int>(Visual)].Add(Instance);
+#else
+		Pools[static_cast<int>(Visual)].push_back(Instance);
+#endif
+		Emit(EGridViewOpType::Hide, Visual, Instance, 0, 0, OutOps);
+		Stats.Hides++;
+	}
+
+	static void Emit(EGridViewOpType Type, EGridVisual Visual, int Instance, int X, int Y, HYSTERIA_VECTOR<FGridViewOp>& OutOps)
+	{
+		FGridViewOp op;
+		op.Type = Type;
+		op.Visual = Visual;
+		op.Instance = Instance;
+		op.X = static_cast<uint8_t>(X);
+		op.Y = static_cast<uint8_t>(Y);
+#ifdef HYSTERIA_USE_UNREAL
+		OutOps.Add(op);
+#else
+		OutOps.push_back(op);
+#endif
+	}
+};
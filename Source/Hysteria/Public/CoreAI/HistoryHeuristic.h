@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include "MoveTable.h"
+#include <atomic>
+#include <cstdint>
+
+// History heuristic: how well each action did in a local situation, learned from the rewards
+// backpropagated through one turn's tree and used to order and prime the children of the next
+// turn's trees. A situation is the agent's cell, its held item and the four neighbouring cell
+// types, hashed into a fixed number of contexts; collisions only blur the priors. Updates are
+// lock-free, so every rollout thread writes to the table directly.
+template <int W, int H, int N_AGENTS>
+class FHistoryTable
+{
+public:
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+	using FMoves = FMoveTable<W, H>;
+
+	static constexpr int NumContexts = 2048;
+	static constexpr int NumActions = static_cast<int>(EActionType::Wait) + 1;
+	static constexpr int NoContext = -1;
+
+	static int GetContext(const FWorldState& State, int Agent)
+	{
+		const AgentState& agent = State.agents[Agent];
+		const int cell = agent.y * W + agent.x;
+		uint32_t key = static_cast<uint32_t>(cell);
+		key = key * 8 + (agent.hasItem ? static_cast<uint32_t>(agent.item) : 0);
+		for (int m = 0; m < FMoves::NumMoves; ++m)
+		{
+			const int neighbor = FMoves::GetNeighbor(cell, m);
+			const CellType type = neighbor != FMoves::NoCell ? State.grid[neighbor / W][neighbor % W] : CellType::Wall;
+			key = key * 4 + static_cast<uint32_t>(type);
+		}
+		key *= 0x9E3779B1u;
+		return static_cast<int>(key >> 21) & (NumContexts - 1);
+	}
+
+	void Update(int Context, EActionType Action, double Reward)
+	{
+		FEntry& entry = Entries[Context][static_cast<int>(Action)];
+		entry.Visits.fetch_add(1, std::memory_order_relaxed);
+		float old = entry.Value.load(std::memory_order_relaxed);
+		while (!entry.Value.compare_exchange_weak(old, old + static_cast<float>(Reward), std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// Mean reward of Action in Context, false if it was never tried there
+	bool GetMean(int Context, EActionType Action, int& OutVisits, double& OutMean) const
+	{
+		const FEntry& entry = Entries[Context][static_cast<int>(Action)];
+		OutVisits = entry.Visits.load(std::memory_order_relaxed);
+		if (OutVisits <= 0) return false;
+		OutMean = entry.Value.load(std::memory_order_relaxed) / OutVisits;
+		return true;
+	}
+
+	// Halves every count, keeping the means, so recent turns outweigh old ones. Only between searches.
+	void Decay()
+	{
+		for (auto& context : Entries)
+		{
+			for (FEntry& entry : context)
+			{
+				const int visits = entry.Visits.load(std::memory_order_relaxed);
+				const int kept = visits / 2;
+				const float value = entry.Value.load(std::memory_order_relaxed);
+				entry.Visits.store(kept, std::memory_order_relaxed);
+				entry.Value.store(kept > 0 ? value * kept / visits : 0.0f, std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct FEntry
+	{
+		std::atomic<int32_t> Visits{0};
+		std::atomic<float> Value{0.0f};
+	};
+
+	FEntry Entries[NumContexts][NumActions];
+};
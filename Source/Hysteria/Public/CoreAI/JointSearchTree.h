@@ -0,0 +1,138 @@
+#pragma once
+
+#include "SearchTree.h"
+#include "WorldState.h"
+#include "Types.h"
+#include <array>
+
+// Decoupled joint search: every rollout simulates one joint trajectory of all agents and
+// updates each searched agent's own FMCTS statistics with that agent's reward. One playout
+// therefore feeds every searched tree at once. Agents that are not searched follow their
+// trajectory in SimContext, from the root's turn on, and their trees are left alone.
+template <int W, int H, int N_AGENTS, typename TLeafEvaluator>
+class FJointMCTS
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FTree = FMCTS<W, H, N_AGENTS, TLeafEvaluator>;
+
+public:
+	FJointMCTS(std::array<FTree, N_AGENTS>& InTrees, const FWorldState& InRootState,
+	           const FSimContext& InSimContext, const std::array<bool, N_AGENTS>& InSearched,
+	           const TLeafEvaluator& InEvaluator = TLeafEvaluator())
+		: Trees(InTrees), RootState(InRootState), SimContext(InSimContext), Searched(InSearched),
+		  Evaluator(InEvaluator)
+	{
+		for (int i = 0; i < N_AGENTS; ++i)
+			bAnySearched |= Searched[i];
+	}
+
+	// Kick off numThreads running joint rollouts until totalRollouts are done or Token is
+	// cancelled; returns the rollouts done
+	int RunSearch(int numThreads, int totalRollouts, const FCancellationToken* Token = nullptr)
+	{
+		HYSTERIA_TRACE_SCOPE("JointMCTS.RunSearch");
+		if (!bAnySearched) return 0;
+		// Trees with a node budget are pruned between batches, while no worker is running
+		bool bBudgeted = false;
+		for (int i = 0; i < N_AGENTS; ++i)
+			bBudgeted |= Trees[i].NodeBudget > 0;
+		const int batch = bBudgeted ? FTree::PruneInterval : totalRollouts;
+
+		int done = 0;
+		while (done < totalRollouts && !(Token && Token->IsCancelled()))
+		{
+			done += RunParallelRollouts(numThreads, std::min(batch, totalRollouts - done), [this](int) { Rollout(); }, Token);
+			for (int i = 0; i < N_AGENTS; ++i)
+				Trees[i].EnforceNodeBudget();
+		}
+		return done;
+	}
+
+	// Runs up to Rollouts joint rollouts on the calling thread, fewer once Token is cancelled,
+	// then prunes budgeted trees; returns the rollouts done
+	int RunSearchSlice(int Rollouts, const FCancellationToken* Token = nullptr)
+	{
+		HYSTERIA_TRACE_SCOPE("JointMCTS.RunSearchSlice");
+		if (!bAnySearched) return 0;
+		int done = 0;
+		for (; done < Rollouts && !(Token && Token->IsCancelled()); ++done)
+			Rollout();
+		for (int i = 0; i < N_AGENTS; ++i)
+			Trees[i].EnforceNodeBudget();
+		return done;
+	}
+
+private:
+	std::array<FTree, N_AGENTS>& Trees;
+	FWorldState RootState;
+	FSimContext SimContext;
+	std::array<bool, N_AGENTS> Searched;
+	bool bAnySearched = false;
+	TLeafEvaluator Evaluator;
+
+	// Single joint rollout (Select→Expand→Simulate→Backprop for every agent)
+	void Rollout()
+	{
+		FWorldState simState = RootState.Clone();
+		FSimulationScratch<N_AGENTS> scratch;
+
+		std::array<FMCTSNode*, N_AGENTS> nodes;
+		for (int i = 0; i < N_AGENTS; ++i)
+			nodes[i] = Trees[i].Root;
+
+		// 1. Selection: searched agents descend together while each is at an inner node
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("JointMCTS.Select");
+			while (AllExpanded(nodes))
+			{
+				std::array<FAgentAction, N_AGENTS> actions;
+				for (int i = 0; i < N_AGENTS; ++i)
+				{
+					if (Searched[i])
+					{
+						nodes[i] = FTree::Select(nodes[i]);
+						actions[i] = nodes[i]->actionFromParent;
+						continue;
+					}
+					// Blocked planned moves wait for the rest of the rollout, as in AgentTurnOverride
+					actions[i] = SimContext.GetPlannedActionForAgent(i, simState.turnCounter, scratch);
+					if (!simState.CanExecute(i, actions[i]))
+						scratch.SetAgentWaitingTemporarily(i, true);
+				}
+				simState.NextState(actions);
+			}
+		}
+
+		// 2. Expansion, each searched agent in its own table
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("JointMCTS.Expand");
+			for (int i = 0; i < N_AGENTS; ++i)
+				if (Searched[i])
+					Trees[i].Expand(nodes[i], simState);
+		}
+
+		// 3. Evaluation: one joint evaluation scores every agent
+		std::array<double, N_AGENTS> rewards;
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("JointMCTS.Evaluate");
+			rewards = Evaluator.EvaluateJoint(simState, SimContext, scratch);
+		}
+
+		// 4. Backpropagation of the per-agent reward vector
+		HYSTERIA_TRACE_ROLLOUT_SCOPE("JointMCTS.Backpropagate");
+		for (int i = 0; i < N_AGENTS; ++i)
+			if (Searched[i])
+				Trees[i].Backpropagate(nodes[i], rewards[i]);
+	}
+
+	bool AllExpanded(const std::array<FMCTSNode*, N_AGENTS>& Nodes) const
+	{
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			if (Searched[i] && (!Nodes[i]->bExpanded || Nodes[i]->children.IsEmpty()))
+				return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "Types.h"
+#include <atomic>
+#include <cstdint>
+#ifdef HYSTERIA_USE_UNREAL
+#include "HAL/CriticalSection.h"
+#include "Templates/UniquePtr.h"
+#else
+#include <memory>
+#include <mutex>
+#endif
+
+// Counters of a FLeafEvalCache, cumulative or for one step (Since)
+struct FLeafCacheStats
+{
+	int64_t Lookups = 0;
+	int64_t Hits = 0;
+	// Leaves that were evaluated, and the time that took
+	int64_t Evaluations = 0;
+	double EvalSeconds = 0.0;
+
+	double GetHitRate() const
+	{
+		return Lookups > 0 ? static_cast<double>(Hits) / Lookups : 0.0;
+	}
+
+	// Hits priced at the average evaluation time
+	double GetSavedSeconds() const
+	{
+		return Evaluations > 0 ? Hits * EvalSeconds / Evaluations : 0.0;
+	}
+
+	FLeafCacheStats Since(const FLeafCacheStats& Earlier) const
+	{
+		FLeafCacheStats delta;
+		delta.Lookups = Lookups - Earlier.Lookups;
+		delta.Hits = Hits - Earlier.Hits;
+		delta.Evaluations = Evaluations - Earlier.Evaluations;
+		delta.EvalSeconds = EvalSeconds - Earlier.EvalSeconds;
+		return delta;
+	}
+};
+
+// Leaf values by WorldState::Hash and agent, shared by all trees of a planner and kept across
+// steps. Each entry is the running mean of the evaluations seen so far; lookups only hit once
+// MinSamples of them are in, so a noisy playout is not frozen after its first sample. A fixed
+// table where a new position replaces whatever shares its slot, locked in stripes.
+class FLeafEvalCache
+{
+public:
+	explicit FLeafEvalCache(int Capacity, int InMinSamples = 1)
+		: MinSamples(InMinSamples < 1 ? 1 : InMinSamples)
+	{
+		NumEntries = 1;
+		while (NumEntries < static_cast<uint64_t>(Capacity))
+			NumEntries <<= 1;
+#ifdef HYSTERIA_USE_UNREAL
+		Entries = MakeUnique<FEntry[]>(NumEntries);
+#else
+		Entries = std::make_unique<FEntry[]>(NumEntries);
+#endif
+	}
+
+	bool Find(uint64_t StateHash, int Agent, double& OutValue)
+	{
+		const uint64_t key = MakeKey(StateHash, Agent);
+		const uint64_t slot = key & (NumEntries - 1);
+		bool bHit = false;
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			FScopeLock Lock(&Locks[slot % NumLocks]);
+#else
+			std::lock_guard<std::mutex> lock(Locks[slot % NumLocks]);
+#endif
+			const FEntry& entry = Entries[slot];
+			if (entry.Key == key && entry.Count >= MinSamples)
+			{
+				OutValue = entry.Mean;
+				bHit = true;
+			}
+		}
+		Lookups.fetch_add(1, std::memory_order_relaxed);
+		if (bHit)
+			Hits.fetch_add(1, std::memory_order_relaxed);
+		return bHit;
+	}
+
+	// Adds one evaluation of the position that took Seconds
+	void Add(uint64_t StateHash, int Agent, double Value, double Seconds)
+	{
+		const uint64_t key = MakeKey(StateHash, Agent);
+		const uint64_t slot = key & (NumEntries - 1);
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			FScopeLock Lock(&Locks[slot % NumLocks]);
+#else
+			std::lock_guard<std::mutex> lock(Locks[slot % NumLocks]);
+#endif
+			FEntry& entry = Entries[slot];
+			if (entry.Key != key)
+			{
+				entry.Key = key;
+				entry.Mean = 0.0;
+				entry.Count = 0;
+			}
+			entry.Count++;
+			entry.Mean += (Value - entry.Mean) / entry.Count;
+		}
+		Evaluations.fetch_add(1, std::memory_order_relaxed);
+		EvalNanoseconds.fetch_add(static_cast<int64_t>(Seconds * 1e9), std::memory_order_relaxed);
+	}
+
+	FLeafCacheStats GetStats() const
+	{
+		FLeafCacheStats stats;
+		stats.Lookups = Lookups.load(std::memory_order_relaxed);
+		stats.Hits = Hits.load(std::memory_order_relaxed);
+		stats.Evaluations = Evaluations.load(std::memory_order_relaxed);
+		stats.EvalSeconds = EvalNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+		return stats;
+	}
+
+	int GetCapacity() const
+	{
+		return static_cast<int>(NumEntries);
+	}
+
+private:
+	struct FEntry
+	{
+		// 0 marks an empty slot
+		uint64_t Key = 0;
+		double Mean = 0.0;
+		int Count = 0;
+	};
+
+	static constexpr int NumLocks = 64;
+
+	uint64_t NumEntries;
+	int MinSamples;
+#ifdef HYSTERIA_USE_UNREAL
+	TUniquePtr<FEntry[]> Entries;
+	FCriticalSection Locks[NumLocks];
+#else
+	std::unique_ptr<FEntry[]> Entries;
+	std::mutex Locks[NumLocks];
+#endif
+	std::atomic<int64_t> Lookups{0};
+	std::atomic<int64_t> Hits{0};
+	std::atomic<int64_t> Evaluations{0};
+	std::atomic<int64_t> EvalNanoseconds{0};
+
+	static uint64_t MakeKey(uint64_t StateHash, int Agent)
+	{
+		// Spread the agent over all bits, so the agents of one position land in different slots
+		uint64_t key = StateHash ^ ((static_cast<uint64_t>(Agent) + 1) * 0x9E3779B97F4A7C15ull);
+		key ^= key >> 29;
+		return key != 0 ? key : 1;
+	}
+};
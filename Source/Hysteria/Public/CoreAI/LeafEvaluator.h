@@ -0,0 +1,277 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include "SimulationContext.h"
+#include "GridSearch.h"
+#include <algorithm>
+#include <array>
+#ifdef HYSTERIA_USE_UNREAL
+#include "Misc/FileHelper.h"
+#else
+#include <fstream>
+#include <random>
+#endif
+
+// Leaf evaluators score a search leaf for one agent (Evaluate), for every agent of a joint
+// simulation (EvaluateJoint) or for many leaves at once (EvaluateBatch, which FMCTS's parallel
+// search calls). FMCTS takes the evaluator as a template parameter, so the choice is made at
+// compile time.
+
+// Default: 10 random plies, then read the score
+template <int W, int H, int N_AGENTS>
+struct FRandomPlayoutEvaluator
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FSimScratch = FSimulationScratch<N_AGENTS>;
+
+	int PlayoutLength = 10;
+
+	// Random playout for Agent while the others follow their planned trajectories
+	double Evaluate(const FWorldState& State, int Agent, const FSimContext& SimContext, FSimScratch& Scratch) const
+	{
+		FWorldState simState = State;
+		for (int i = 0; i < PlayoutLength; ++i)
+		{
+			FAgentAction action;
+			if (!RandomLegalAction(simState, Agent, action)) break;
+			simState.AgentTurnOverride(SimContext, Scratch, Agent, action);
+		}
+		return simState.agents[Agent].score;
+	}
+
+	// Random joint playout, returns every agent's score. Agents with a trajectory in SimContext
+	// (the unsearched agents of a joint search) follow it instead of moving at random.
+	std::array<double, N_AGENTS> EvaluateJoint(const FWorldState& State, const FSimContext& SimContext,
+	                                           FSimScratch& Scratch) const
+	{
+		FWorldState simState = State;
+		for (int ply = 0; ply < PlayoutLength; ++ply)
+		{
+			std::array<FAgentAction, N_AGENTS> actions;
+			for (int i = 0; i < N_AGENTS; ++i)
+			{
+				if (!SimContext.HasTrajectory(i))
+				{
+					RandomLegalAction(simState, i, actions[i]);
+					continue;
+				}
+				actions[i] = SimContext.GetPlannedActionForAgent(i, simState.turnCounter, Scratch);
+				if (!simState.CanExecute(i, actions[i]))
+					Scratch.SetAgentWaitingTemporarily(i, true);
+			}
+			simState.NextState(actions);
+		}
+
+		std::array<double, N_AGENTS> rewards;
+		for (int i = 0; i < N_AGENTS; ++i)
+			rewards[i] = simState.agents[i].score;
+		return rewards;
+	}
+
+	// Scores Count leaves for Agent, each with the scratch its rollout left behind
+	void EvaluateBatch(const FWorldState* States, FSimScratch* Scratches, int Count, int Agent,
+	                   const FSimContext& SimContext, double* OutValues) const
+	{
+		for (int n = 0; n < Count; ++n)
+			OutValues[n] = Evaluate(States[n], Agent, SimContext, Scratches[n]);
+	}
+
+	// Picks a uniformly random legal action, Wait if there is none
+	static bool RandomLegalAction(FWorldState& State, int Agent, FAgentAction& OutAction)
+	{
+		HYSTERIA_VECTOR<FAgentAction> actions = State.GetLegalActionsForAgent(Agent);
+		OutAction = FAgentAction{EActionType::Wait};
+#ifdef HYSTERIA_USE_UNREAL
+		if (actions.IsEmpty()) return false;
+		OutAction = actions[FMath::RandRange(0, actions.Num() - 1)];
+#else
+		if (actions.empty()) return false;
+		static thread_local std::mt19937 rng(std::random_device{}());
+		std::uniform_int_distribution<size_t> dist(0, actions.size() - 1);
+		OutAction = actions[dist(rng)];
+#endif
+		return true;
+	}
+};
+
+// Hand-picked features of an agent's situation, shared by the static and the linear evaluator
+template <int W, int H, int N_AGENTS>
+struct FLeafFeatures
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+
+	enum : int
+	{
+		Score,
+		HoldsUsefulItem,
+		CoinProximity,
+		FireProximity,
+		UsefulItemProximity,
+		Bias,
+		Count
+	};
+
+	using FVector = std::array<double, Count>;
+
+	// Proximities are 1 / (1 + walking distance), 0 if unreachable. Distances come from the
+	// precomputed fields when available and from a BFS otherwise.
+	static FVector Extract(const FWorldState& State, int Agent, const FDistanceFieldCache<W, H>* Fields)
+	{
+		const AgentState& agent = State.agents[Agent];
+		const ItemType held = agent.hasItem ? agent.item : ItemType::None;
+		bool bHasFire = false;
+		bool bHasObstacle = false;
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				bHasFire |= State.grid[y][x] == CellType::Fire;
+				bHasObstacle |= State.grid[y][x] == CellType::PlayerObstacle;
+			}
+		}
+		const bool bHoseUseful = held == ItemType::Hose && bHasFire;
+		const bool bPickaxeUseful = held == ItemType::Pickaxe && bHasObstacle;
+
+		FVector features = {};
+		features[Score] = agent.score;
+		features[HoldsUsefulItem] = (bHoseUseful || bPickaxeUseful) ? 1.0 : 0.0;
+		features[Bias] = 1.0;
+
+		if (Fields)
+		{
+			features[CoinProximity] = Proximity(Fields->GetDistance(EDistanceTarget::Coin, agent.x, agent.y));
+			if (bHoseUseful)
+				features[FireProximity] = Proximity(Fields->GetDistance(EDistanceTarget::Fire, agent.x, agent.y));
+			if (held == ItemType::None)
+			{
+				const int hose = bHasFire ? Fields->GetDistance(EDistanceTarget::Hose, agent.x, agent.y) : -1;
+				const int pickaxe = bHasObstacle ? Fields->GetDistance(EDistanceTarget::Pickaxe, agent.x, agent.y) : -1;
+				features[UsefulItemProximity] = std::max(Proximity(hose), Proximity(pickaxe));
+			}
+			return features;
+		}
+
+		EActionType step;
+		features[CoinProximity] = Proximity(GridSearch::FindNearest(State, agent.x, agent.y, [&State](int X, int Y)
+		{
+			return State.items[Y][X] == ItemType::Coin;
+		}, step));
+
+		if (bHoseUseful)
+		{
+			features[FireProximity] = Proximity(GridSearch::FindNearest(State, agent.x, agent.y, [&State](int X, int Y)
+			{
+				return GridSearch::HasNeighborCell(State, X, Y, CellType::Fire);
+			}, step));
+		}
+
+		if (held == ItemType::None && (bHasFire || bHasObstacle))
+		{
+			features[UsefulItemProximity] = Proximity(GridSearch::FindNearest(State, agent.x, agent.y,
+				[&State, bHasFire, bHasObstacle](int X, int Y)
+				{
+					return (bHasFire && State.items[Y][X] == ItemType::Hose) ||
+						(bHasObstacle && State.items[Y][X] == ItemType::Pickaxe);
+				}, step));
+		}
+		return features;
+	}
+
+	static double Proximity(int Distance)
+	{
+		return Distance < 0 ? 0.0 : 1.0 / (1 + Distance);
+	}
+};
+
+// Linear model over FLeafFeatures: one feature extraction instead of a playout
+template <int W, int H, int N_AGENTS>
+struct FLinearLeafEvaluator
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FSimScratch = FSimulationScratch<N_AGENTS>;
+	using FFeatures = FLeafFeatures<W, H, N_AGENTS>;
+
+	typename FFeatures::FVector Weights = DefaultWeights();
+
+	// Hand-tuned so that being next to a coin or fire is worth about as much as the 10 points
+	// a random playout would collect there
+	static typename FFeatures::FVector DefaultWeights()
+	{
+		typename FFeatures::FVector weights = {};
+		weights[FFeatures::Score] = 1.0;
+		weights[FFeatures::HoldsUsefulItem] = 4.0;
+		weights[FFeatures::CoinProximity] = 8.0;
+		weights[FFeatures::FireProximity] = 8.0;
+		weights[FFeatures::UsefulItemProximity] = 4.0;
+		weights[FFeatures::Bias] = 0.0;
+		return weights;
+	}
+
+	// Reads FFeatures::Count whitespace separated weights, e.g. exported from an offline fit.
+	// Keeps the current weights and returns false if the file is missing or too short.
+	bool LoadWeights(const HYSTERIA_STRING& Path)
+	{
+		typename FFeatures::FVector loaded = {};
+#ifdef HYSTERIA_USE_UNREAL
+		FString Content;
+		if (!FFileHelper::LoadFileToString(Content, *Path)) return false;
+		TArray<FString> Tokens;
+		Content.ParseIntoArrayWS(Tokens);
+		if (Tokens.Num() < FFeatures::Count) return false;
+		for (int i = 0; i < FFeatures::Count; ++i)
+			loaded[i] = FCString::Atod(*Tokens[i]);
+#else
+		std::ifstream file(Path);
+		for (int i = 0; i < FFeatures::Count; ++i)
+		{
+			if (!(file >> loaded[i])) return false;
+		}
+#endif
+		Weights = loaded;
+		return true;
+	}
+
+	double Evaluate(const FWorldState& State, int Agent, const FSimContext& SimContext, FSimScratch&) const
+	{
+		return Dot(FFeatures::Extract(State, Agent, GetFieldsFor(State, SimContext)));
+	}
+
+	std::array<double, N_AGENTS> EvaluateJoint(const FWorldState& State, const FSimContext& SimContext, FSimScratch&) const
+	{
+		const FDistanceFieldCache<W, H>* fields = GetFieldsFor(State, SimContext);
+		std::array<double, N_AGENTS> values;
+		for (int i = 0; i < N_AGENTS; ++i)
+			values[i] = Dot(FFeatures::Extract(State, i, fields));
+		return values;
+	}
+
+	void EvaluateBatch(const FWorldState* States, FSimScratch* Scratches, int Count, int Agent,
+	                   const FSimContext& SimContext, double* OutValues) const
+	{
+		for (int n = 0; n < Count; ++n)
+			OutValues[n] = Evaluate(States[n], Agent, SimContext, Scratches[n]);
+	}
+
+	// The context's fields describe the search root. A leaf is a Clone of the root moved on by
+	// the rollout, so they still hold only if the rollout wrote no tile or item; otherwise a
+	// collected coin would still count as near. Those leaves fall back to BFS.
+	static const FDistanceFieldCache<W, H>* GetFieldsFor(const FWorldState& State, const FSimContext& SimContext)
+	{
+		return State.HasCellChanges() ? nullptr : SimContext.GetDistanceFields();
+	}
+
+	double Dot(const typename FFeatures::FVector& Features) const
+	{
+		double value = 0.0;
+		for (int i = 0; i < FFeatures::Count; ++i)
+			value += Weights[i] * Features[i];
+		return value;
+	}
+};
+
+// Deterministic static evaluation with the hand-tuned default weights
+template <int W, int H, int N_AGENTS>
+using FStaticLeafEvaluator = FLinearLeafEvaluator<W, H, N_AGENTS>;
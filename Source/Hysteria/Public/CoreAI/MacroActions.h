@@ -0,0 +1,196 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include "SimulationContext.h"
+#include "GridSearch.h"
+
+// Go-to-target options the planner can search over instead of single moves. Each macro walks a
+// shortest path to the nearest matching target and finishes with one primitive action there.
+enum class EMacroAction : uint8_t
+{
+	None,           // Plain primitive action, macro mode off
+	CollectCoin,    // Walk to the nearest coin and pick it up
+	FetchHose,      // Walk to the nearest hose and pick it up
+	FetchPickaxe,   // Walk to the nearest pickaxe and pick it up
+	ExtinguishFire, // Walk next to the nearest fire and use the held hose
+	ClearObstacle,  // Walk next to the nearest obstacle and use the held pickaxe
+	HeadToRegion,   // Walk into the next region towards the most valuable distant region
+	Wait            // Stay for one turn, only offered if no other macro is
+};
+
+template <int W, int H, int N_AGENTS>
+struct FMacroActions
+{
+	using FWorldState = WorldState<W, H, N_AGENTS>;
+	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FSimScratch = FSimulationScratch<N_AGENTS>;
+	using FPathTree = GridSearch::FPathTree<W, H>;
+	using FRegions = FRegionMap<W, H>;
+
+	static constexpr int MaxMacros = 7;
+	static constexpr int MaxPathLength = W * H;
+
+	// Macros with a reachable target, and the first primitive action each one would take.
+	// If the context carries a region map, targets are only searched within its local horizon
+	// and anything farther away is reached through HeadToRegion.
+	static int GetLegalMacros(const FWorldState& State, const FSimContext& SimContext, int Agent,
+	                          EMacroAction* OutMacros, FAgentAction* OutFirstActions)
+	{
+		static constexpr EMacroAction Candidates[] = {
+			EMacroAction::CollectCoin, EMacroAction::FetchHose, EMacroAction::FetchPickaxe,
+			EMacroAction::ExtinguishFire, EMacroAction::ClearObstacle, EMacroAction::HeadToRegion
+		};
+
+		const FRegions* regions = SimContext.GetRegions();
+		FPathTree paths;
+		BuildPaths(State, Agent, regions, paths);
+
+		int count = 0;
+		for (EMacroAction macro : Candidates)
+		{
+			int target;
+			EActionType finalAction;
+			if (!Resolve(State, Agent, paths, regions, macro, target, finalAction)) continue;
+
+			EActionType firstMove = finalAction;
+			if (paths.Distance[target] > 0)
+				FirstMove(paths, target, firstMove);
+			OutMacros[count] = macro;
+			OutFirstActions[count] = FAgentAction(firstMove);
+			count++;
+		}
+		// Agents never block each other, so waiting only helps when there is nothing to go for.
+		// Offering it next to real targets lets the search put every goal off by one more turn.
+		if (count == 0)
+		{
+			OutMacros[count] = EMacroAction::Wait;
+			OutFirstActions[count] = FAgentAction(EActionType::Wait);
+			count++;
+		}
+		return count;
+	}
+
+	// Applies the whole macro to State, the other agents following the simulation context.
+	// Executed primitives are appended to OutPrimitives if given. Returns the number of plies.
+	static int Execute(FWorldState& State, const FSimContext& SimContext, FSimScratch& Scratch, int Agent,
+	                   EMacroAction Macro, HYSTERIA_VECTOR<FAgentAction>* OutPrimitives = nullptr)
+	{
+		EActionType moves[MaxPathLength];
+		int numMoves = 0;
+		EActionType finalAction = EActionType::Wait;
+
+		if (Macro != EMacroAction::Wait)
+		{
+			const FRegions* regions = SimContext.GetRegions();
+			FPathTree paths;
+			BuildPaths(State, Agent, regions, paths);
+			int target;
+			if (Resolve(State, Agent, paths, regions, Macro, target, finalAction))
+				numMoves = paths.GetPath(target, moves, MaxPathLength);
+			else
+				finalAction = EActionType::Wait;
+		}
+
+		for (int i = 0; i < numMoves; ++i)
+			ApplyPly(State, SimContext, Scratch, Agent, FAgentAction(moves[i]), OutPrimitives);
+		// Entering the next region is all HeadToRegion does, the following macro takes over there
+		if (Macro == EMacroAction::HeadToRegion && numMoves > 0)
+			return numMoves;
+		ApplyPly(State, SimContext, Scratch, Agent, FAgentAction(finalAction), OutPrimitives);
+		return numMoves + 1;
+	}
+
+private:
+	static void BuildPaths(const FWorldState& State, int Agent, const FRegions* Regions, FPathTree& OutPaths)
+	{
+		OutPaths.Build(State, State.agents[Agent].x, State.agents[Agent].y,
+		               Regions ? FRegions::LocalHorizon : MaxPathLength);
+	}
+
+	static void ApplyPly(FWorldState& State, const FSimContext& SimContext, FSimScratch& Scratch, int Agent,
+	                     const FAgentAction& Action, HYSTERIA_VECTOR<FAgentAction>* OutPrimitives)
+	{
+		State.AgentTurnOverride(SimContext, Scratch, Agent, Action);
+		if (OutPrimitives)
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			OutPrimitives->Add(Action);
+#else
+			OutPrimitives->push_back(Action);
+#endif
+		}
+	}
+
+	static void FirstMove(const FPathTree& Paths, int Target, EActionType& OutMove)
+	{
+		EActionType moves[MaxPathLength];
+		if (Paths.GetPath(Target, moves, MaxPathLength) > 0)
+			OutMove = moves[0];
+	}
+
+	// Finds the target cell of a macro and the action to take once there
+	static bool Resolve(const FWorldState& State, int Agent, const FPathTree& Paths, const FRegions* Regions,
+	                    EMacroAction Macro, int& OutTarget, EActionType& OutFinalAction)
+	{
+		const AgentState& agent = State.agents[Agent];
+		const ItemType held = agent.hasItem ? agent.item : ItemType::None;
+		ItemType wantedItem = ItemType::None;
+		CellType usedOn = CellType::Empty;
+
+		switch (Macro)
+		{
+		case EMacroAction::CollectCoin:
+			wantedItem = ItemType::Coin;
+			break;
+		case EMacroAction::FetchHose:
+			if (held == ItemType::Hose) return false;
+			wantedItem = ItemType::Hose;
+			break;
+		case EMacroAction::FetchPickaxe:
+			if (held == ItemType::Pickaxe) return false;
+			wantedItem = ItemType::Pickaxe;
+			break;
+		case EMacroAction::ExtinguishFire:
+			if (held != ItemType::Hose) return false;
+			usedOn = CellType::Fire;
+			break;
+		case EMacroAction::ClearObstacle:
+			if (held != ItemType::Pickaxe) return false;
+			usedOn = CellType::PlayerObstacle;
+			break;
+		case EMacroAction::HeadToRegion:
+		{
+			// Abstract search picks the region, the cell path only reaches its nearest entrance
+			int goal, nextHop;
+			if (!Regions || !Regions->FindGoal(agent.x, agent.y, held, goal, nextHop)) return false;
+			OutFinalAction = EActionType::Wait;
+			OutTarget = Paths.FindNearest([Regions, nextHop](int X, int Y)
+			{
+				return Regions->RegionOf[Y][X] == nextHop;
+			});
+			return OutTarget >= 0;
+		}
+		default:
+			return false;
+		}
+
+		if (wantedItem != ItemType::None)
+		{
+			OutFinalAction = EActionType::Pickup;
+			OutTarget = Paths.FindNearest([&State, wantedItem](int X, int Y)
+			{
+				return State.items[Y][X] == wantedItem;
+			});
+		}
+		else
+		{
+			OutFinalAction = EActionType::UseItem;
+			OutTarget = Paths.FindNearest([&State, usedOn](int X, int Y)
+			{
+				return GridSearch::HasNeighborCell(State, X, Y, usedOn);
+			});
+		}
+		return OutTarget >= 0;
+	}
+};
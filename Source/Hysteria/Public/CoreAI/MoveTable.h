@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Types.h"
+#include <array>
+#include <cstdint>
+
+// Grid topology lookups shared by every world of one size. Moves are indexed like the move
+// actions of EActionType (Down, Up, Left, Right), so a move action is its own table index.
+template <int W, int H>
+struct FMoveTable
+{
+	static constexpr int NumMoves = 4;
+	static constexpr int NoCell = -1;
+	static constexpr int MoveDX[NumMoves] = {0, 0, -1, 1};
+	static constexpr int MoveDY[NumMoves] = {1, -1, 0, 0};
+	// EDirection (Up, Down, Left, Right) to move index
+	static constexpr int DirectionToMove[NumMoves] = {1, 0, 2, 3};
+
+	static constexpr bool IsMove(EActionType Type)
+	{
+		return static_cast<int>(Type) < NumMoves;
+	}
+
+	static constexpr int MoveIndex(EDirection Direction)
+	{
+		return DirectionToMove[static_cast<int>(Direction)];
+	}
+
+	// Neighbour cell index (y * W + x) per cell and move, NoCell past the border. Constant
+	// initialised at compile time where the compiler's constexpr limits allow W * H, built
+	// once at startup otherwise.
+	static constexpr std::array<int32_t, W * H * NumMoves> BuildNeighbors()
+	{
+		std::array<int32_t, W * H * NumMoves> neighbors = {};
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				for (int m = 0; m < NumMoves; ++m)
+				{
+					const int nx = x + MoveDX[m];
+					const int ny = y + MoveDY[m];
+					const bool bInside = nx >= 0 && nx < W && ny >= 0 && ny < H;
+					neighbors[(y * W + x) * NumMoves + m] = bInside ? ny * W + nx : NoCell;
+				}
+			}
+		}
+		return neighbors;
+	}
+
+	static inline const std::array<int32_t, W * H * NumMoves> Neighbors = BuildNeighbors();
+
+	static int GetNeighbor(int Cell, int Move)
+	{
+		return Neighbors[Cell * NumMoves + Move];
+	}
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Types.h"
+#include "BinaryArchive.h"
+#include "MacroActions.h"
+#include <array>
+#include <cstdint>
+
+// Root statistics of one agent's search as kept in an opening book
+struct FBookRootStats
+{
+	// One per EActionType, like FMCTSChildren
+	static constexpr int MaxChildren = 8;
+
+	struct FChild
+	{
+		EActionType Action = EActionType::Wait;
+		EMacroAction Macro = EMacroAction::None;
+		int Visits = 0;
+		double Value = 0.0;
+	};
+
+	bool bMacroActions = false;
+	int NumChildren = 0;
+	FChild Children[MaxChildren];
+
+	int GetTotalVisits() const
+	{
+		int total = 0;
+		for (int i = 0; i < NumChildren; ++i)
+			total += Children[i].Visits;
+		return total;
+	}
+};
+
+template <int N_AGENTS>
+using FBookEntry = std::array<FBookRootStats, N_AGENTS>;
+
+// Precomputed root statistics for known positions, keyed by WorldState::Hash. Built offline by
+// HysteriaBookBuilder from deep searches; the planner seeds new trees from it.
+template <int W, int H, int N_AGENTS>
+class FOpeningBook
+{
+public:
+	const FBookEntry<N_AGENTS>* Find(uint64_t StateHash) const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return Entries.Find(StateHash);
+#else
+		auto it = Entries.find(StateHash);
+		return it != Entries.end() ? &it->second : nullptr;
+#endif
+	}
+
+	// Keeps the deeper of the stored and the new search of Agent for a position
+	void Record(uint64_t StateHash, int Agent, const FBookRootStats& Stats)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		FBookRootStats& stored = Entries.FindOrAdd(StateHash)[Agent];
+#else
+		FBookRootStats& stored = Entries[StateHash][Agent];
+#endif
+		if (Stats.GetTotalVisits() > stored.GetTotalVisits())
+			stored = Stats;
+	}
+
+	int Num() const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return Entries.Num();
+#else
+		return static_cast<int>(Entries.size());
+#endif
+	}
+
+	bool Save(const HYSTERIA_STRING& Path) const
+	{
+		FBinaryWriter Writer;
+		Writer.Write(BookMagic);
+		Writer.Write(BookVersion);
+		Writer.Write(static_cast<int32_t>(W));
+		Writer.Write(static_cast<int32_t>(H));
+		Writer.Write(static_cast<int32_t>(N_AGENTS));
+		Writer.Write(static_cast<uint32_t>(Num()));
+#ifdef HYSTERIA_USE_UNREAL
+		for (const auto& Pair : Entries)
+			WriteEntry(Writer, Pair.Key, Pair.Value);
+#else
+		for (const auto& entry : Entries)
+			WriteEntry(Writer, entry.first, entry.second);
+#endif
+		return Writer.SaveToFile(Path);
+	}
+
+	// Adds the positions of a book file; false if it is missing, invalid or for another map size
+	bool Load(const HYSTERIA_STRING& Path)
+	{
+		FMappedFile File;
+		if (!File.Open(Path)) return false;
+		FBinaryReader Reader(File.GetData(), File.GetSize());
+
+		uint32_t magic = 0, version = 0, count = 0;
+		int32_t width = 0, height = 0, numAgents = 0;
+		Reader.Read(magic);
+		Reader.Read(version);
+		Reader.Read(width);
+		Reader.Read(height);
+		Reader.Read(numAgents);
+		Reader.Read(count);
+		if (Reader.HasFailed() || magic != BookMagic || version != BookVersion ||
+			width != W || height != H || numAgents != N_AGENTS)
+			return false;
+
+		for (uint32_t e = 0; e < count; ++e)
+		{
+			uint64_t hash = 0;
+			FBookEntry<N_AGENTS> entry;
+			Reader.Read(hash);
+			for (FBookRootStats& stats : entry)
+			{
+				uint8_t macroMode = 0, numChildren = 0;
+				Reader.Read(macroMode);
+				Reader.Read(numChildren);
+				if (Reader.HasFailed() || numChildren > FBookRootStats::MaxChildren) return false;
+				stats.bMacroActions = macroMode != 0;
+				stats.NumChildren = numChildren;
+				for (int c = 0; c < numChildren; ++c)
+				{
+					uint8_t action = 0, macro = 0;
+					int32_t visits = 0;
+					Reader.Read(action);
+					Reader.Read(macro);
+					Reader.Read(visits);
+					Reader.Read(stats.Children[c].Value);
+					if (action > static_cast<uint8_t>(EActionType::Wait) || macro > static_cast<uint8_t>(EMacroAction::Wait))
+						return false;
+					stats.Children[c].Action = static_cast<EActionType>(action);
+					stats.Children[c].Macro = static_cast<EMacroAction>(macro);
+					stats.Children[c].Visits = visits;
+				}
+			}
+			if (Reader.HasFailed()) return false;
+#ifdef HYSTERIA_USE_UNREAL
+			Entries.Add(hash, entry);
+#else
+			Entries[hash] = entry;
+#endif
+		}
+		return true;
+	}
+
+private:
+	static constexpr uint32_t BookMagic = 0x42535948; // "HYSB"
+	// 2: positions keyed by the word-at-a-time WorldState::Hash
+	static constexpr uint32_t BookVersion = 2;
+
+	HYSTERIA_MAP<uint64_t, FBookEntry<N_AGENTS>> Entries;
+
+	static void WriteEntry(FBinaryWriter& Writer, uint64_t Hash, const FBookEntry<N_AGENTS>& Entry)
+	{
+		Writer.Write(Hash);
+		for (const FBookRootStats& stats : Entry)
+		{
+			Writer.Write(static_cast<uint8_t>(stats.bMacroActions));
+			Writer.Write(static_cast<uint8_t>(stats.NumChildren));
+			for (int c = 0; c < stats.NumChildren; ++c)
+			{
+				Writer.Write(static_cast<uint8_t>(stats.Children[c].Action));
+				Writer.Write(static_cast<uint8_t>(stats.Children[c].Macro));
+				Writer.Write(static_cast<int32_t>(stats.Children[c].Visits));
+				Writer.Write(stats.Children[c].Value);
+			}
+		}
+	}
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Types.h"
+#include <cstdint>
+#include <cstring>
+
+// Coarse abstraction of the grid for long-horizon planning. The map is cut into SectorSize x
+// SectorSize sectors and every 4-connected group of non-wall cells inside a sector becomes one
+// region. Only walls define regions; fire and obstacles can be cleared, so they stay passable
+// on the abstract level. Search runs between regions and is refined to cells near the agent.
+template <int W, int H, int SectorSize = 4>
+class FRegionMap
+{
+public:
+	static constexpr int NumSectors = ((W + SectorSize - 1) / SectorSize) * ((H + SectorSize - 1) / SectorSize);
+	// A checkerboard is the most fragmented a sector can get
+	static constexpr int MaxRegions = NumSectors * ((SectorSize * SectorSize + 1) / 2);
+	static constexpr int MaxNeighbors = 4 * SectorSize;
+	// Cell-level search is limited to this walking distance around the agent
+	static constexpr int LocalHorizon = SectorSize * SectorSize;
+	static constexpr int16_t NoRegion = -1;
+
+	int16_t RegionOf[H][W];
+	int NumRegions = 0;
+	int16_t Neighbors[MaxRegions][MaxNeighbors];
+	uint8_t NumNeighbors[MaxRegions];
+	// What lies in each region, refreshed with UpdateValues
+	uint16_t Coins[MaxRegions];
+	uint16_t Hoses[MaxRegions];
+	uint16_t Pickaxes[MaxRegions];
+	uint16_t Fires[MaxRegions];
+	uint16_t Obstacles[MaxRegions];
+
+	FRegionMap()
+	{
+		std::memset(WallLayout, 0, sizeof(WallLayout));
+		std::memset(RegionOf, 0xFF, sizeof(RegionOf));
+	}
+
+	// Rebuilds the regions if the wall layout differs from the one they were built from
+	template <typename TCellGrid>
+	bool RebuildIfWallsChanged(const TCellGrid& Grid)
+	{
+		bool bChanged = NumRegions == 0;
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				const bool bWall = Grid[y][x] == CellType::Wall;
+				bChanged |= WallLayout[y][x] != bWall;
+				WallLayout[y][x] = bWall;
+			}
+		}
+		if (bChanged)
+			Rebuild();
+		return bChanged;
+	}
+
+	template <typename TCellGrid, typename TItemGrid>
+	void UpdateValues(const TCellGrid& Grid, const TItemGrid& Items)
+	{
+		TotalFires = 0;
+		TotalObstacles = 0;
+		for (int r = 0; r < NumRegions; ++r)
+			Coins[r] = Hoses[r] = Pickaxes[r] = Fires[r] = Obstacles[r] = 0;
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				const int r = RegionOf[y][x];
+				if (r == NoRegion) continue;
+				Coins[r] += Items[y][x] == ItemType::Coin;
+				Hoses[r] += Items[y][x] == ItemType::Hose;
+				Pickaxes[r] += Items[y][x] == ItemType::Pickaxe;
+				Fires[r] += Grid[y][x] == CellType::Fire;
+				Obstacles[r] += Grid[y][x] == CellType::PlayerObstacle;
+			}
+		}
+		for (int r = 0; r < NumRegions; ++r)
+		{
+			TotalFires += Fires[r];
+			TotalObstacles += Obstacles[r];
+		}
+	}
+
+	// How much a region is worth walking to for an agent holding Held: coins always, fire or
+	// obstacles with the matching tool, and tools while there is something to use them on
+	float GetValue(int Region, ItemType Held) const
+	{
+		float value = Coins[Region];
+		if (Held == ItemType::Hose) value += Fires[Region];
+		if (Held == ItemType::Pickaxe) value += Obstacles[Region];
+		if (Held != ItemType::Hose && TotalFires > 0) value += 0.5f * Hoses[Region];
+		if (Held != ItemType::Pickaxe && TotalObstacles > 0) value += 0.5f * Pickaxes[Region];
+		return value;
+	}
+
+	// Breadth-first search over the region graph from the region of (X, Y). Every hop counts as
+	// SectorSize cells, which is exact enough to rank goals and far cheaper than Dijkstra inside
+	// rollouts. Fills OutDistance (-1 if unreachable) and OutFirstHop (first region on the way).
+	void SearchFrom(int X, int Y, int* OutDistance, int16_t* OutFirstHop) const
+	{
+		for (int r = 0; r < NumRegions; ++r)
+		{
+			OutDistance[r] = -1;
+			OutFirstHop[r] = NoRegion;
+		}
+		const int start = RegionOf[Y][X];
+		if (start == NoRegion) return;
+
+		int16_t queue[MaxRegions];
+		int head = 0, tail = 0;
+		OutDistance[start] = 0;
+		queue[tail++] = static_cast<int16_t>(start);
+		while (head < tail)
+		{
+			const int current = queue[head++];
+			for (int n = 0; n < NumNeighbors[current]; ++n)
+			{
+				const int next = Neighbors[current][n];
+				if (OutDistance[next] >= 0) continue;
+				OutDistance[next] = OutDistance[current] + SectorSize;
+				OutFirstHop[next] = current == start ? static_cast<int16_t>(next) : OutFirstHop[current];
+				queue[tail++] = static_cast<int16_t>(next);
+			}
+		}
+	}
+
+	// Best region outside the one of (X, Y) by value per abstract distance and the first region
+	// to walk into on the way there. Returns false if no other region holds any value.
+	bool FindGoal(int X, int Y, ItemType Held, int& OutGoal, int& OutNextHop) const
+	{
+		int distance[MaxRegions];
+		int16_t firstHop[MaxRegions];
+		SearchFrom(X, Y, distance, firstHop);
+
+		const int start = RegionOf[Y][X];
+		float bestScore = 0.0f;
+		OutGoal = NoRegion;
+		for (int r = 0; r < NumRegions; ++r)
+		{
+			if (r == start || distance[r] < 0) continue;
+			const float score = GetValue(r, Held) / (1.0f + distance[r]);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				OutGoal = r;
+			}
+		}
+		OutNextHop = OutGoal == NoRegion ? NoRegion : firstHop[OutGoal];
+		return OutGoal != NoRegion;
+	}
+
+private:
+	bool WallLayout[H][W];
+	int TotalFires = 0;
+	int TotalObstacles = 0;
+
+	void Rebuild()
+	{
+		std::memset(RegionOf, 0xFF, sizeof(RegionOf));
+		NumRegions = 0;
+		static constexpr int DX[4] = {0, 0, -1, 1};
+		static constexpr int DY[4] = {1, -1, 0, 0};
+
+		// Flood fill each sector separately
+		int16_t queue[W * H];
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				if (WallLayout[y][x] || RegionOf[y][x] != NoRegion) continue;
+
+				const int region = NumRegions++;
+				const int sectorX = x / SectorSize;
+				const int sectorY = y / SectorSize;
+				int head = 0, tail = 0;
+				RegionOf[y][x] = static_cast<int16_t>(region);
+				queue[tail++] = static_cast<int16_t>(y * W + x);
+				while (head < tail)
+				{
+					const int cx = queue[head] % W;
+					const int cy = queue[head] / W;
+					head++;
+					for (int d = 0; d < 4; ++d)
+					{
+						const int nx = cx + DX[d];
+						const int ny = cy + DY[d];
+						if (nx < 0 || nx >= W || ny < 0 || ny >= H) continue;
+						if (nx / SectorSize != sectorX || ny / SectorSize != sectorY) continue;
+						if (WallLayout[ny][nx] || RegionOf[ny][nx] != NoRegion) continue;
+						RegionOf[ny][nx] = static_cast<int16_t>(region);
+						queue[tail++] = static_cast<int16_t>(ny * W + nx);
+					}
+				}
+				NumNeighbors[region] = 0;
+				Coins[region] = Hoses[region] = Pickaxes[region] = Fires[region] = Obstacles[region] = 0;
+			}
+		}
+
+		// Link regions that touch across a sector border
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				const int a = RegionOf[y][x];
+				if (a == NoRegion) continue;
+				if (x + 1 < W && RegionOf[y][x + 1] != NoRegion && RegionOf[y][x + 1] != a)
+					Link(a, RegionOf[y][x + 1]);
+				if (y + 1 < H && RegionOf[y + 1][x] != NoRegion && RegionOf[y + 1][x] != a)
+					Link(a, RegionOf[y + 1][x]);
+			}
+		}
+	}
+
+	void Link(int A, int B)
+	{
+		AddNeighbor(A, B);
+		AddNeighbor(B, A);
+	}
+
+	void AddNeighbor(int A, int B)
+	{
+		for (int n = 0; n < NumNeighbors[A]; ++n)
+		{
+			if (Neighbors[A][n] == B) return;
+		}
+		if (NumNeighbors[A] < MaxNeighbors)
+			Neighbors[A][NumNeighbors[A]++] = static_cast<int16_t>(B);
+	}
+};
@@ -4,12 +4,23 @@
 #ifdef HYSTERIA_USE_UNREAL
 #include "Async/Async.h"
 #include "HAL/CriticalSection.h"
+#include "Templates/UniquePtr.h"
 #else
 #include <mutex>
 #include <random>
+#include <thread>
 #endif
 #include <algorithm>
+#include <functional>
+#include <vector>
 #include "WorldState.h"
+#include "LeafEvaluator.h"
+#include "LeafCache.h"
+#include "HistoryHeuristic.h"
+#include "Cancellation.h"
+#include "MacroActions.h"
+#include "OpeningBook.h"
+#include "Trace.h"
 #include "Types.h"
 
 #ifdef HYSTERIA_USE_UNREAL
@@ -33,6 +44,76 @@ struct FLambdaWorker
 };
 #endif
 
+// Runs totalRollouts rollouts spread over numThreads workers, which claim them BatchSize at a
+// time and run each claim with Job(Count); returns how many ran. A cancelled Token stops every
+// worker before its next claim.
+template <typename TJob>
+int RunParallelRollouts(int numThreads, int totalRollouts, TJob Job, const FCancellationToken* Token = nullptr,
+                        int BatchSize = 1)
+{
+	std::atomic<int> rolloutCount{0};
+
+	auto Worker = [&]()
+	{
+		HYSTERIA_TRACE_SCOPE("MCTS.Worker");
+		while (true)
+		{
+			if (Token && Token->IsCancelled()) break;
+			int n = rolloutCount.fetch_add(BatchSize);
+			if (n >= totalRollouts) break;
+			Job(std::min(BatchSize, totalRollouts - n));
+		}
+	};
+
+#ifdef HYSTERIA_USE_UNREAL
+	// Unreal Engine uses Async tasks for multithreading
+	TArray<FAsyncTask<FLambdaWorker<decltype(Worker)>>*> Tasks;
+	for (int i = 0; i < numThreads; ++i)
+	{
+		auto* Task = new FAsyncTask<FLambdaWorker<decltype(Worker)>>(Worker);
+		Task->StartBackgroundTask();
+		Tasks.Add(Task);
+	}
+
+	// Time spent here past the fastest worker is the wait on stragglers
+	HYSTERIA_TRACE_SCOPE("MCTS.Join");
+	for (auto* Task : Tasks)
+	{
+		Task->EnsureCompletion();
+		delete Task;
+	}
+#else
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; ++i)
+		threads.emplace_back(Worker);
+	// Time spent here past the fastest worker is the wait on stragglers
+	HYSTERIA_TRACE_SCOPE("MCTS.Join");
+	for (auto& t : threads) t.join();
+#endif
+	return std::min(rolloutCount.load(), totalRollouts);
+}
+
+template <int W, int H, int N_AGENTS, typename TLeafEvaluator = FRandomPlayoutEvaluator<W, H, N_AGENTS>>
+class FJointMCTS;
+
+struct FMCTSNode;
+
+// Children of an expanded node: an inline fixed-capacity array of pointers into one contiguous
+// block of the tree's node pool. Sized for the largest action set, the pointers fill one cache line.
+struct FMCTSChildren
+{
+	// Number of EActionType values; macro sets are smaller
+	static constexpr int Capacity = 8;
+
+	FMCTSNode* Items[Capacity];
+	int Count = 0;
+
+	FMCTSNode* const* begin() const { return Items; }
+	FMCTSNode* const* end() const { return Items + Count; }
+	int Num() const { return Count; }
+	bool IsEmpty() const { return Count == 0; }
+};
+
 struct FMCTSNode
 {
 	// Statistics for this node
@@ -45,8 +126,12 @@ struct FMCTSNode
 
 	// Tree structure
 	FAgentAction actionFromParent;
+	// In macro mode the whole macro is applied; actionFromParent is its first primitive
+	EMacroAction macroFromParent = EMacroAction::None;
+	// History table context of this node's state, set when it is expanded with primitive actions
+	int16_t historyContext = -1;
 	FMCTSNode* parent = nullptr;
-	HYSTERIA_VECTOR<FMCTSNode*> children;
+	FMCTSChildren children;
 
 	// Expansion guard
 #ifdef HYSTERIA_USE_UNREAL
@@ -62,38 +147,181 @@ struct FMCTSNode
 		parent = InParent;
 		actionFromParent = InAction;
 	}
+
+	// Back to a fresh node before the pool hands it out again
+	void Reset()
+	{
+		currVisits = 0;
+		currValue = 0.0;
+		pastVisits = 0;
+		pastValue = 0.0;
+		virtualLoss = 0;
+		actionFromParent = FAgentAction();
+		macroFromParent = EMacroAction::None;
+		historyContext = -1;
+		parent = nullptr;
+		children.Count = 0;
+		bExpanded = false;
+	}
 };
 
-template <int W, int H, int N_AGENTS>
+// Memory use of one search tree
+struct FTreeMemoryStats
+{
+	int Nodes = 0;
+	int PeakNodes = 0;
+	// Nodes recycled by budget pruning over the tree's lifetime
+	int PrunedNodes = 0;
+	// Pool memory held by the tree, including recycled nodes
+	size_t Bytes = 0;
+};
+
+// Hands out nodes from chunks that live as long as the tree, so an expansion takes one
+// contiguous block and the whole tree is freed at once. Pruned blocks are kept on free lists
+// by size and reused before a new chunk is opened.
+class FMCTSNodePool
+{
+public:
+	static constexpr int ChunkSize = 1024;
+
+	FMCTSNode* Allocate(int Count)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		FScopeLock Lock(&Mutex);
+#else
+		std::lock_guard<std::mutex> lock(Mutex);
+#endif
+		FMCTSNode* block = TakeFreeBlock(Count);
+		if (!block)
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			if (Chunks.IsEmpty() || Used + Count > ChunkSize)
+			{
+				Chunks.Add(TUniquePtr<FMCTSNode[]>(new FMCTSNode[ChunkSize]));
+				Used = 0;
+			}
+			block = &Chunks.Last()[Used];
+#else
+			if (Chunks.empty() || Used + Count > ChunkSize)
+			{
+				Chunks.emplace_back(new FMCTSNode[ChunkSize]);
+				Used = 0;
+			}
+			block = &Chunks.back()[Used];
+#endif
+			Used += Count;
+		}
+		NumNodes += Count;
+		PeakNodes = std::max(PeakNodes, NumNodes.load());
+		return block;
+	}
+
+	// Returns a block from Allocate (or a remainder of one). No thread may still reference it.
+	void Free(FMCTSNode* Block, int Count)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		FScopeLock Lock(&Mutex);
+#else
+		std::lock_guard<std::mutex> lock(Mutex);
+#endif
+		for (int i = 0; i < Count; ++i)
+			Block[i].Reset();
+		AddFreeBlock(Block, Count);
+		NumNodes -= Count;
+		PrunedNodes += Count;
+	}
+
+	int GetNumNodes() const
+	{
+		return NumNodes.load();
+	}
+
+	FTreeMemoryStats GetStats() const
+	{
+		FTreeMemoryStats stats;
+		stats.Nodes = NumNodes.load();
+		stats.PeakNodes = PeakNodes;
+		stats.PrunedNodes = PrunedNodes;
+#ifdef HYSTERIA_USE_UNREAL
+		stats.Bytes = sizeof(FMCTSNodePool) + static_cast<size_t>(Chunks.Num()) * ChunkSize * sizeof(FMCTSNode);
+#else
+		stats.Bytes = sizeof(FMCTSNodePool) + Chunks.size() * ChunkSize * sizeof(FMCTSNode);
+#endif
+		return stats;
+	}
+
+private:
+#ifdef HYSTERIA_USE_UNREAL
+	FCriticalSection Mutex;
+	TArray<TUniquePtr<FMCTSNode[]>> Chunks;
+	TArray<FMCTSNode*> FreeBlocks[FMCTSChildren::Capacity + 1];
+#else
+	std::mutex Mutex;
+	std::vector<std::unique_ptr<FMCTSNode[]>> Chunks;
+	std::vector<FMCTSNode*> FreeBlocks[FMCTSChildren::Capacity + 1];
+#endif
+	int Used = 0;
+	std::atomic<int> NumNodes{0};
+	int PeakNodes = 0;
+	int PrunedNodes = 0;
+
+	// Smallest free block that fits; the unused tail goes back on the free lists
+	FMCTSNode* TakeFreeBlock(int Count)
+	{
+		for (int size = Count; size <= FMCTSChildren::Capacity; ++size)
+		{
+#ifdef HYSTERIA_USE_UNREAL
+			if (FreeBlocks[size].IsEmpty()) continue;
+			FMCTSNode* block = FreeBlocks[size].Pop();
+#else
+			if (FreeBlocks[size].empty()) continue;
+			FMCTSNode* block = FreeBlocks[size].back();
+			FreeBlocks[size].pop_back();
+#endif
+			if (size > Count)
+				AddFreeBlock(block + Count, size - Count);
+			return block;
+		}
+		return nullptr;
+	}
+
+	void AddFreeBlock(FMCTSNode* Block, int Count)
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		FreeBlocks[Count].Add(Block);
+#else
+		FreeBlocks[Count].push_back(Block);
+#endif
+	}
+};
+
+template <int W, int H, int N_AGENTS, typename TLeafEvaluator = FRandomPlayoutEvaluator<W, H, N_AGENTS>>
 class FMCTS
 {
 	using FWorldState = WorldState<W, H, N_AGENTS>;
 	using FSimContext = FSimulationContext<W, H, N_AGENTS>;
+	using FSimScratch = FSimulationScratch<N_AGENTS>;
 
 public:
-	FMCTS(const FWorldState& InRootState, const int AgentNr) : RootState(InRootState)
+	FMCTS(const FWorldState& InRootState, const int AgentNr, const TLeafEvaluator& InEvaluator = TLeafEvaluator())
+		: RootState(InRootState), Evaluator(InEvaluator)
 	{
 		agentNr = AgentNr;
-		Root = new FMCTSNode(nullptr, FAgentAction{EActionType::Wait});
+		Pool = HYSTERIA_MAKE_SHARED<FMCTSNodePool>();
+		Root = Pool->Allocate(1);
+		Root->actionFromParent = FAgentAction{EActionType::Wait};
 	}
 
 	FMCTS() = default;
 
-	~FMCTS()
-	{
-		// TODO: recursively delete entire tree
-	}
-
 	HYSTERIA_VECTOR<FAgentAction> GetBestTrajectory() const
 	{
 		// Collect the best trajectory from the root node
 		HYSTERIA_VECTOR<FAgentAction> trajectory;
+		FWorldState simState = RootState;
+		FSimScratch Scratch;
 		FMCTSNode* node = Root;
-#ifdef HYSTERIA_USE_UNREAL
 		while (node && !node->children.IsEmpty())
-#else
-		while (node && !node->children.empty())
-#endif
 		{
 			// Find the child with the highest visit count
 			FMCTSNode* bestChild = nullptr;
@@ -108,62 +336,270 @@ public:
 				}
 			}
 			if (!bestChild) break; // No children found
+			if (bestChild->macroFromParent != EMacroAction::None)
+			{
+				// Expand the macro into the primitives it executes
+				FMacroActions<W, H, N_AGENTS>::Execute(simState, SimContext, Scratch, agentNr,
+				                                       bestChild->macroFromParent, &trajectory);
+			}
+			else
+			{
 #ifdef HYSTERIA_USE_UNREAL
-			trajectory.Add(bestChild->actionFromParent);
+				trajectory.Add(bestChild->actionFromParent);
 #else
-			trajectory.push_back(bestChild->actionFromParent);
+				trajectory.push_back(bestChild->actionFromParent);
 #endif
+			}
 			node = bestChild;
 		}
 		return trajectory;
 	}
 
-	// Kick off numThreads running rollouts until totalRollouts are done
-	void RunSearch(int numThreads, int totalRollouts, FSimContext InSimContext)
+	// Plan over go-to-target macros (FMacroActions) instead of single moves. Set before searching.
+	void SetUseMacroActions(bool bEnabled)
+	{
+		bUseMacroActions = bEnabled;
+	}
+
+	// Action priors learned by earlier trees of the same agent; nullptr keeps uniform, shuffled children
+	void SetHistoryTable(const HYSTERIA_SHARED_PTR<FHistoryTable<W, H, N_AGENTS>>& Table)
+	{
+		History = Table;
+	}
+
+	// Leaf values shared with other trees; nullptr evaluates every leaf
+	void SetLeafCache(const HYSTERIA_SHARED_PTR<FLeafEvalCache>& Cache)
+	{
+		LeafCache = Cache;
+	}
+
+	// Leaves one parallel worker selects, each under virtual loss, before scoring them together
+	static constexpr int LeafBatchSize = 4;
+
+	// Kick off numThreads running rollouts until totalRollouts are done or Token is cancelled;
+	// returns the rollouts done
+	int RunSearch(int numThreads, int totalRollouts, const FSimContext& InSimContext, const FCancellationToken* Token = nullptr)
 	{
+		HYSTERIA_TRACE_SCOPE("MCTS.RunSearch");
+		// Shares the immutable trajectory snapshot; workers only ever read it
 		this->SimContext = InSimContext;
+		auto Job = [this](int Count) { RolloutBatch(Count); };
+		if (NodeBudget <= 0)
+			return RunParallelRollouts(numThreads, totalRollouts, Job, Token, LeafBatchSize);
 
-		
-#ifdef HYSTERIA_USE_UNREAL
-		// Unreal Engine uses Async tasks for multithreading
-		auto MyJob = [&]()
+		// With a budget, search in batches and prune in between while no worker is running
+		int done = 0;
+		while (done < totalRollouts && !(Token && Token->IsCancelled()))
+		{
+			done += RunParallelRollouts(numThreads, std::min(PruneInterval, totalRollouts - done), Job, Token, LeafBatchSize);
+			EnforceNodeBudget();
+		}
+		return done;
+	}
+
+	// Runs Rollouts rollouts on the calling thread and enforces the node budget afterwards.
+	// Lets a caller search in small pieces that can be stopped between any two of them.
+	int RunSearchSlice(int Rollouts, const FSimContext& InSimContext, const FCancellationToken* Token = nullptr)
+	{
+		HYSTERIA_TRACE_SCOPE("MCTS.RunSearchSlice");
+		this->SimContext = InSimContext;
+		int done = 0;
+		for (; done < Rollouts && !(Token && Token->IsCancelled()); ++done)
+			Rollout();
+		EnforceNodeBudget();
+		return done;
+	}
+
+	// Caps the tree at MaxNodes (0 = unbounded). Once the cap is reached leaves stop expanding;
+	// between search batches the least visited subtrees are collapsed into their parent, whose
+	// statistics already include them, and their nodes are recycled.
+	void SetNodeBudget(int MaxNodes)
+	{
+		NodeBudget = MaxNodes;
+	}
+
+	// Collapses least visited subtrees until the tree is at PruneTarget of its budget.
+	// Must not run concurrently with a search.
+	void EnforceNodeBudget()
+	{
+		if (NodeBudget <= 0 || !IsOverBudget()) return;
+		HYSTERIA_TRACE_SCOPE("MCTS.Prune");
+		const int target = static_cast<int>(NodeBudget * PruneTarget);
+
+		// Candidates are expanded nodes whose children are all leaves, so collapsing one
+		// frees exactly one block. Collapsing can turn the parent into a candidate.
+		auto MoreVisited = [](const FMCTSNode* A, const FMCTSNode* B)
+		{
+			return TotalVisits(A) > TotalVisits(B);
+		};
+		std::vector<FMCTSNode*> heap;
+		CollectPruneCandidates(Root, heap);
+		std::make_heap(heap.begin(), heap.end(), MoreVisited);
+
+		while (!heap.empty() && Pool->GetNumNodes() > target)
 		{
-			int n = 0;
-			while (n < totalRollouts)
+			std::pop_heap(heap.begin(), heap.end(), MoreVisited);
+			FMCTSNode* node = heap.back();
+			heap.pop_back();
+
+			Pool->Free(node->children.Items[0], node->children.Count);
+			node->children.Count = 0;
+			node->bExpanded = false;
+
+			FMCTSNode* parent = node->parent;
+			if (parent && parent != Root && HasOnlyLeafChildren(parent))
 			{
-				Rollout();
-				n++;
+				heap.push_back(parent);
+				std::push_heap(heap.begin(), heap.end(), MoreVisited);
 			}
-		};
-		
-		TArray<FAsyncTask<FLambdaWorker<decltype(MyJob)>>*> Tasks;
-		for (int i = 0; i < numThreads; ++i)
+		}
+	}
+
+	FTreeMemoryStats GetMemoryStats() const
+	{
+		return Pool ? Pool->GetStats() : FTreeMemoryStats();
+	}
+
+	// Root children statistics, e.g. for an opening book
+	FBookRootStats GetRootStats() const
+	{
+		FBookRootStats stats;
+		stats.bMacroActions = bUseMacroActions;
+		for (auto* child : Root->children)
 		{
-			auto* Task = new FAsyncTask<FLambdaWorker<decltype(MyJob)>>(MyJob);
-			Task->StartBackgroundTask();
-			Tasks.Add(Task);
+			FBookRootStats::FChild& entry = stats.Children[stats.NumChildren++];
+			entry.Action = child->actionFromParent.Type;
+			entry.Macro = child->macroFromParent;
+			entry.Visits = TotalVisits(child);
+			entry.Value = child->currValue.load() + child->pastValue;
 		}
-		
-		for (auto* Task : Tasks)
-			Task->EnsureCompletion();
-#else		
-		std::atomic<int> rolloutCount{0};
+		return stats;
+	}
+
+	// Expands the root with the children of an opening book entry and takes their statistics
+	// as past visits and value, so the first rollouts already follow the book. Ignored once
+	// the root is expanded or if the entry was built in the other action mode.
+	bool SeedRoot(const FBookRootStats& Stats)
+	{
+		if (Root->bExpanded || Stats.NumChildren == 0 || Stats.bMacroActions != bUseMacroActions) return false;
 
-		auto Worker = [&]()
+		FAgentAction actions[FBookRootStats::MaxChildren];
+		for (int i = 0; i < Stats.NumChildren; ++i)
+			actions[i] = FAgentAction(Stats.Children[i].Action);
+		FMCTSNode* block = AddChildren(Root, actions, Stats.NumChildren);
+		for (int i = 0; i < Stats.NumChildren; ++i)
 		{
-			while (true)
+			block[i].macroFromParent = Stats.Children[i].Macro;
+			block[i].pastVisits = Stats.Children[i].Visits;
+			block[i].pastValue = Stats.Children[i].Value;
+		}
+		Root->bExpanded = true;
+		return true;
+	}
+
+	// Writes the tree breadth-first, siblings next to each other. With TopK > 0 only about the
+	// TopK most visited nodes are kept: a node keeps its children only if all of them make the
+	// cut, otherwise it is stored as a leaf that carries its statistics.
+	void Save(FBinaryWriter& Writer, int TopK = 0) const
+	{
+		std::vector<const FMCTSNode*> order;
+		order.push_back(Root);
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			for (auto* child : order[i]->children)
+				order.push_back(child);
+		}
+
+		int threshold = 0;
+		if (TopK > 0 && static_cast<int>(order.size()) > TopK)
+		{
+			std::vector<int> visits;
+			for (auto* node : order)
+				visits.push_back(TotalVisits(node));
+			std::nth_element(visits.begin(), visits.begin() + (TopK - 1), visits.end(), std::greater<int>());
+			threshold = visits[TopK - 1];
+
+			order.clear();
+			order.push_back(Root);
+			for (size_t i = 0; i < order.size(); ++i)
 			{
-				int n = rolloutCount.fetch_add(1);
-				if (n >= totalRollouts) break;
-				Rollout();
+				if (KeepsChildren(order[i], threshold))
+				{
+					for (auto* child : order[i]->children)
+						order.push_back(child);
+				}
 			}
-		};
+		}
 
-		std::vector<std::thread> threads;	
-		for (int i = 0; i < numThreads; ++i)
-			threads.emplace_back(Worker);
-		for (auto& t : threads) t.join();
-#endif
+		Writer.Write(static_cast<uint8_t>(bUseMacroActions));
+		Writer.Write(static_cast<uint32_t>(order.size()));
+		for (auto* node : order)
+		{
+			Writer.Write(static_cast<uint8_t>(node->actionFromParent.Type));
+			Writer.Write(static_cast<uint8_t>(node->macroFromParent));
+			Writer.Write(static_cast<uint8_t>(KeepsChildren(node, threshold) ? node->children.Count : 0));
+			Writer.Write(static_cast<int32_t>(node->currVisits.load()));
+			Writer.Write(node->currValue.load());
+			Writer.Write(static_cast<int32_t>(node->pastVisits));
+			Writer.Write(node->pastValue);
+		}
+	}
+
+	// Replaces this tree's nodes with a tree written by Save; the root state stays as constructed
+	bool Load(FBinaryReader& Reader)
+	{
+		uint8_t macroMode = 0;
+		uint32_t numNodes = 0;
+		Reader.Read(macroMode);
+		Reader.Read(numNodes);
+		if (Reader.HasFailed() || numNodes == 0) return false;
+
+		Pool = HYSTERIA_MAKE_SHARED<FMCTSNodePool>();
+		Root = Pool->Allocate(1);
+		bUseMacroActions = macroMode != 0;
+
+		// Children of the i-th node are the next unclaimed run of nodes in the file
+		std::vector<FMCTSNode*> nodes(numNodes, nullptr);
+		nodes[0] = Root;
+		uint32_t nextChild = 1;
+		for (uint32_t i = 0; i < numNodes; ++i)
+		{
+			uint8_t action, macro, numChildren;
+			int32_t currVisits, pastVisits;
+			double currValue, pastValue;
+			Reader.Read(action);
+			Reader.Read(macro);
+			Reader.Read(numChildren);
+			Reader.Read(currVisits);
+			Reader.Read(currValue);
+			Reader.Read(pastVisits);
+			Reader.Read(pastValue);
+			if (Reader.HasFailed() || !nodes[i] || numChildren > FMCTSChildren::Capacity ||
+				nextChild + numChildren > numNodes || action > static_cast<uint8_t>(EActionType::Wait) ||
+				macro > static_cast<uint8_t>(EMacroAction::Wait))
+				return false;
+
+			FMCTSNode* node = nodes[i];
+			node->actionFromParent = FAgentAction(static_cast<EActionType>(action));
+			node->macroFromParent = static_cast<EMacroAction>(macro);
+			node->currVisits = currVisits;
+			node->currValue = currValue;
+			node->pastVisits = pastVisits;
+			node->pastValue = pastValue;
+			if (numChildren == 0) continue;
+
+			FMCTSNode* block = Pool->Allocate(numChildren);
+			for (int c = 0; c < numChildren; ++c)
+			{
+				block[c].parent = node;
+				node->children.Items[c] = &block[c];
+				nodes[nextChild + c] = &block[c];
+			}
+			node->children.Count = numChildren;
+			node->bExpanded = true;
+			nextChild += numChildren;
+		}
+		return true;
 	}
 
 	// After search, pick the action with highest (visit or blended) score
@@ -189,6 +625,90 @@ public:
 		return best ? best->actionFromParent : FAgentAction{EActionType::Wait};
 	}
 
+	// How contested the root decision is: the visit share gap and the mean value gap
+	// between the two most visited root children
+	void GetRootDecisionGap(double& OutVisitGap, double& OutValueGap) const
+	{
+		const FMCTSNode* first = nullptr;
+		const FMCTSNode* second = nullptr;
+		int total = 0;
+		for (auto* c : Root->children)
+		{
+			const int v = c->currVisits.load();
+			total += v;
+			if (!first || v > first->currVisits.load())
+			{
+				second = first;
+				first = c;
+			}
+			else if (!second || v > second->currVisits.load())
+			{
+				second = c;
+			}
+		}
+
+		// A single option (or none) is never contested
+		OutVisitGap = 1.0;
+		OutValueGap = 1.0;
+		if (!first || !second || total == 0) return;
+
+		const int v1 = first->currVisits.load();
+		const int v2 = second->currVisits.load();
+		OutVisitGap = static_cast<double>(v1 - v2) / total;
+
+		const double q1 = v1 > 0 ? first->currValue.load() / v1 : 0.0;
+		const double q2 = v2 > 0 ? second->currValue.load() / v2 : 0.0;
+		OutValueGap = std::abs(q1 - q2) / (1.0 + std::abs(q1) + std::abs(q2));
+	}
+
+	int GetRootVisits() const
+	{
+		int total = 0;
+		for (auto* c : Root->children)
+			total += c->currVisits.load();
+		return total;
+	}
+
+	// Longest path from the root, in tree plies
+	int GetDepth() const
+	{
+		int depth = 0;
+		std::vector<std::pair<const FMCTSNode*, int>> stack;
+		stack.push_back({Root, 0});
+		while (!stack.empty())
+		{
+			const auto [node, nodeDepth] = stack.back();
+			stack.pop_back();
+			depth = std::max(depth, nodeDepth);
+			for (auto* child : node->children)
+				stack.push_back({child, nodeDepth + 1});
+		}
+		return depth;
+	}
+
+	// Moves the search onto a root state changed by a world edit, keeping the tree. With
+	// Weight < 1 every node's statistics become past statistics scaled by Weight: a prior the
+	// rollouts in the edited world soon overrule. Must not run concurrently with a search.
+	void Rebase(const FWorldState& NewRootState, double Weight = 1.0)
+	{
+		RootState = NewRootState;
+		if (Weight >= 1.0) return;
+
+		std::vector<FMCTSNode*> stack;
+		stack.push_back(Root);
+		while (!stack.empty())
+		{
+			FMCTSNode* node = stack.back();
+			stack.pop_back();
+			node->pastVisits = static_cast<int>((node->pastVisits + node->currVisits.load()) * Weight);
+			node->pastValue = (node->pastValue + node->currValue.load()) * Weight;
+			node->currVisits = 0;
+			node->currValue = 0.0;
+			for (auto* child : node->children)
+				stack.push_back(child);
+		}
+	}
+
 	// Warm-start: archive stats then reset curr* for next iteration
 	void ArchiveAndResetStats() const
 	{
@@ -202,10 +722,28 @@ public:
 	}
 
 private:
-	FMCTSNode* Root;
+	// Joint search drives the per-agent tables of several trees from one shared simulation
+	friend class FJointMCTS<W, H, N_AGENTS, TLeafEvaluator>;
+
+	// Owns every node of the tree
+	HYSTERIA_SHARED_PTR<FMCTSNodePool> Pool;
+	FMCTSNode* Root = nullptr;
 	FWorldState RootState;
 	int agentNr;
 	FSimContext SimContext;
+	TLeafEvaluator Evaluator;
+	HYSTERIA_SHARED_PTR<FLeafEvalCache> LeafCache;
+	HYSTERIA_SHARED_PTR<FHistoryTable<W, H, N_AGENTS>> History;
+	// Most past visits a history prior gives a new child
+	static constexpr int HistoryPriorVisits = 20;
+	bool bUseMacroActions = false;
+	static constexpr double MacroDiscount = 0.99;
+	int NodeBudget = 0;
+	// Rollouts between two budget checks, and the share of the budget pruning goes down to
+	static constexpr int PruneInterval = 256;
+	static constexpr double PruneTarget = 0.75;
+	static_assert(FMacroActions<W, H, N_AGENTS>::MaxMacros <= FMCTSChildren::Capacity, "Macro set exceeds the child capacity");
+	static_assert(FBookRootStats::MaxChildren == FMCTSChildren::Capacity, "Opening book and tree child capacity differ");
 
 	// Single-rollout entry (Select→Expand→Simulate→Backprop)
 	void Rollout()
@@ -213,31 +751,140 @@ private:
 		// Clone the root state for simulation
 		FWorldState simState = RootState.Clone();
 
-		SimContext.ResetTemporaryData();
+		// Mutable per-rollout data lives on this worker's stack
+		FSimScratch Scratch;
+
+		// 1.-2. Selection and expansion
+		int plies = 0;
+		FMCTSNode* node = SelectAndExpand(simState, Scratch, plies);
+
+		// 3. Evaluation of the leaf
+		double reward;
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("MCTS.Evaluate");
+			reward = EvaluateLeaf(simState, Scratch);
+		}
+
+		// 4. Backpropagation
+		BackpropagateLeaf(node, reward, plies);
+	}
+
+	// Count rollouts (at most LeafBatchSize) whose leaves are scored by one EvaluateBatch call.
+	// Virtual loss steers each selection away from the leaves already held; cache hits are
+	// backed up at once and leave the batch.
+	void RolloutBatch(int Count)
+	{
+		// Reused across calls so a worker clones into the same storage every batch
+		static thread_local std::vector<FWorldState> States;
+		States.clear();
+		FSimScratch scratches[LeafBatchSize];
+		FMCTSNode* leaves[LeafBatchSize];
+		int leafPlies[LeafBatchSize];
+		uint64_t hashes[LeafBatchSize];
+		Count = std::min(Count, LeafBatchSize);
+
+		for (int n = 0; n < Count; ++n)
+		{
+			const int slot = static_cast<int>(States.size());
+			States.push_back(RootState.Clone());
+			scratches[slot].Reset();
+			int plies = 0;
+			FMCTSNode* node = SelectAndExpand(States[slot], scratches[slot], plies);
+
+			double cached;
+			if (LeafCache)
+			{
+				hashes[slot] = States[slot].Hash();
+				if (LeafCache->Find(hashes[slot], agentNr, cached))
+				{
+					States.pop_back();
+					BackpropagateLeaf(node, cached, plies);
+					continue;
+				}
+			}
+			leaves[slot] = node;
+			leafPlies[slot] = plies;
+		}
 
-		// 1. Selection
+		const int pending = static_cast<int>(States.size());
+		if (pending == 0) return;
+		double values[LeafBatchSize];
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("MCTS.Evaluate");
+			const double start = HysteriaNowSeconds();
+			Evaluator.EvaluateBatch(States.data(), scratches, pending, agentNr, SimContext, values);
+			if (LeafCache)
+			{
+				// The cache ranks entries by cost, so each leaf is charged its share of the call
+				const double seconds = (HysteriaNowSeconds() - start) / pending;
+				for (int i = 0; i < pending; ++i)
+					LeafCache->Add(hashes[i], agentNr, values[i], seconds);
+			}
+		}
+
+		for (int i = 0; i < pending; ++i)
+			BackpropagateLeaf(leaves[i], values[i], leafPlies[i]);
+	}
+
+	// Walks State from the root to a leaf, reserving the path with virtual loss, and expands it
+	FMCTSNode* SelectAndExpand(FWorldState& simState, FSimScratch& Scratch, int& plies)
+	{
 		FMCTSNode* node = Root;
-		while (node->bExpanded)
 		{
-			node = Select(node);
-			simState.AgentTurnOverride(SimContext, agentNr, node->actionFromParent);
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("MCTS.Select");
+			while (node->bExpanded && !node->children.IsEmpty())
+			{
+				node = Select(node);
+				if (node->macroFromParent != EMacroAction::None)
+				{
+					plies += FMacroActions<W, H, N_AGENTS>::Execute(simState, SimContext, Scratch, agentNr, node->macroFromParent);
+				}
+				else
+				{
+					simState.AgentTurnOverride(SimContext, Scratch, agentNr, node->actionFromParent);
+					plies++;
+				}
+			}
 		}
 
-		// 2. Expansion
-		Expand(node, simState);
+		{
+			HYSTERIA_TRACE_ROLLOUT_SCOPE("MCTS.Expand");
+			Expand(node, simState);
+		}
+		return node;
+	}
 
-		// 3. Simulation
-		double reward = Simulate(simState);
+	void BackpropagateLeaf(FMCTSNode* node, double reward, int plies)
+	{
+		// Macros take different numbers of turns, so the same reward counts less the longer it took
+		if (bUseMacroActions)
+			reward *= std::pow(MacroDiscount, plies);
 
-		// 4. Backpropagation
+		HYSTERIA_TRACE_ROLLOUT_SCOPE("MCTS.Backpropagate");
 		Backpropagate(node, reward);
-		SimContext.ResetTemporaryData();
+	}
+
+	double EvaluateLeaf(const FWorldState& State, FSimScratch& Scratch)
+	{
+		if (!LeafCache)
+			return Evaluator.Evaluate(State, agentNr, SimContext, Scratch);
+
+		const uint64_t hash = State.Hash();
+		double value;
+		if (LeafCache->Find(hash, agentNr, value))
+			return value;
+		const double start = HysteriaNowSeconds();
+		value = Evaluator.Evaluate(State, agentNr, SimContext, Scratch);
+		LeafCache->Add(hash, agentNr, value, HysteriaNowSeconds() - start);
+		return value;
 	}
 
 	// Thread-safe selection with virtual loss
-	static FMCTSNode* Select(const FMCTSNode* node)
+	static FMCTSNode* Select(FMCTSNode* node)
 	{
-		FMCTSNode* best = nullptr;
+		// Callers only descend through expanded nodes; a leaf selects itself
+		if (node->children.IsEmpty()) return node;
+		FMCTSNode* best = node->children.Items[0];
 		double bestScore = -1e9;
 		int parentVisits = node->currVisits.load();
 		for (auto* child : node->children)
@@ -268,60 +915,139 @@ private:
 #endif
 		if (node->bExpanded) return;
 
+		// Over budget the node stays a leaf until the next prune makes room
+		if (NodeBudget > 0 && IsOverBudget()) return;
+
+		if (bUseMacroActions)
+		{
+			// Macro order is already fixed by target type, no shuffle needed
+			EMacroAction macros[FMacroActions<W, H, N_AGENTS>::MaxMacros];
+			FAgentAction firstActions[FMacroActions<W, H, N_AGENTS>::MaxMacros];
+			const int count = FMacroActions<W, H, N_AGENTS>::GetLegalMacros(state, SimContext, agentNr, macros, firstActions);
+			FMCTSNode* block = AddChildren(node, firstActions, count);
+			for (int i = 0; i < count; ++i)
+				block[i].macroFromParent = macros[i];
+			node->bExpanded = true;
+			return;
+		}
+
 		// list of legal FAgentAction from node’s state for this agent
-		HYSTERIA_VECTOR<FAgentAction> actions = state.GetLegalActionsForAgent(agentNr);
+		FAgentAction actions[FMCTSChildren::Capacity];
+		const int count = state.GetLegalActionsForAgent(agentNr, actions);
 
 		// Shuffle actions to avoid order bias
 #ifdef HYSTERIA_USE_UNREAL
-		for (int32 i = actions.Num() - 1; i >= 0; i--) {
-			int32 j = FMath::Floor(FMath::Rand() * (i + 1)) % actions.Num();
+		for (int32 i = count - 1; i >= 0; i--) {
+			int32 j = FMath::Floor(FMath::Rand() * (i + 1)) % count;
 			FAgentAction temp = actions[i];
 			actions[i] = actions[j];
 			actions[j] = temp;
 		}
 #else
 		static thread_local std::mt19937 rng(std::random_device{}());
-		std::shuffle(actions.begin(), actions.end(), rng);
+		std::shuffle(actions, actions + count, rng);
 #endif
 
-		for (auto& a : actions)
+		if (!History)
 		{
-			auto* child = new FMCTSNode(node, a);
-#ifdef HYSTERIA_USE_UNREAL
-			node->children.Add(child);
-#else
-			node->children.push_back(child);
-#endif
+			AddChildren(node, actions, count);
+			node->bExpanded = true;
+			return;
+		}
+
+		// Best known actions first, so ties in selection go their way, primed with their history
+		const int context = FHistoryTable<W, H, N_AGENTS>::GetContext(state, agentNr);
+		int visits[FMCTSChildren::Capacity] = {};
+		double means[FMCTSChildren::Capacity] = {};
+		int order[FMCTSChildren::Capacity];
+		for (int i = 0; i < count; ++i)
+		{
+			order[i] = i;
+			History->GetMean(context, actions[i].Type, visits[i], means[i]);
+		}
+		std::stable_sort(order, order + count, [&](int A, int B)
+		{
+			return (visits[A] > 0 ? means[A] : -1e9) > (visits[B] > 0 ? means[B] : -1e9);
+		});
+
+		FAgentAction sorted[FMCTSChildren::Capacity];
+		for (int i = 0; i < count; ++i)
+			sorted[i] = actions[order[i]];
+		FMCTSNode* block = AddChildren(node, sorted, count);
+		for (int i = 0; i < count; ++i)
+		{
+			const int prior = std::min(visits[order[i]], HistoryPriorVisits);
+			block[i].pastVisits = prior;
+			block[i].pastValue = prior * means[order[i]];
 		}
+		node->historyContext = static_cast<int16_t>(context);
 		node->bExpanded = true;
 	}
 
-	// Simulate a random playout from state
-	double Simulate(const FWorldState& state)
+	static int TotalVisits(const FMCTSNode* Node)
 	{
-		FWorldState simState = state;
-		for (int i = 0; i < 10; ++i)
+		return Node->currVisits.load() + Node->pastVisits;
+	}
+
+	static bool KeepsChildren(const FMCTSNode* Node, int Threshold)
+	{
+		for (auto* child : Node->children)
 		{
-			HYSTERIA_VECTOR<FAgentAction> actions = simState.GetLegalActionsForAgent(agentNr);
-#ifdef HYSTERIA_USE_UNREAL
-			if (actions.IsEmpty()) break;
-			FAgentAction action = actions[FMath::RandRange(0, actions.Num() - 1)];
-#else
-			if (actions.empty()) break;
-			static thread_local std::mt19937 rng(std::random_device{}());
-			std::uniform_int_distribution<size_t> dist(0, actions.size() - 1);
-			FAgentAction action = actions[dist(rng)];
-#endif
-			simState.AgentTurnOverride(SimContext, agentNr, action);
+			if (TotalVisits(child) < Threshold) return false;
+		}
+		return true;
+	}
+
+	// True once another expansion might not fit
+	bool IsOverBudget() const
+	{
+		return Pool->GetNumNodes() + FMCTSChildren::Capacity > NodeBudget;
+	}
+
+	static bool HasOnlyLeafChildren(const FMCTSNode* Node)
+	{
+		for (auto* child : Node->children)
+		{
+			if (child->bExpanded) return false;
+		}
+		return true;
+	}
+
+	// The root is never collapsed, its children are the move choice
+	void CollectPruneCandidates(FMCTSNode* Node, std::vector<FMCTSNode*>& OutCandidates)
+	{
+		if (!Node->bExpanded || Node->children.IsEmpty()) return;
+		if (Node != Root && HasOnlyLeafChildren(Node))
+		{
+			OutCandidates.push_back(Node);
+			return;
+		}
+		for (auto* child : Node->children)
+			CollectPruneCandidates(child, OutCandidates);
+	}
+
+	// Takes one block of Count nodes from the pool as the children of Node
+	FMCTSNode* AddChildren(FMCTSNode* Node, const FAgentAction* Actions, int Count)
+	{
+		if (Count == 0) return nullptr;
+		FMCTSNode* block = Pool->Allocate(Count);
+		for (int i = 0; i < Count; ++i)
+		{
+			block[i].parent = Node;
+			block[i].actionFromParent = Actions[i];
+			Node->children.Items[i] = &block[i];
 		}
-		return simState.agents[agentNr].score;
+		Node->children.Count = Count;
+		return block;
 	}
 
 	// Backpropagate reward
-	static void Backpropagate(FMCTSNode* node, double reward)
+	void Backpropagate(FMCTSNode* node, double reward)
 	{
 		while (node)
 		{
+			if (History && node->parent && node->parent->historyContext >= 0)
+				History->Update(node->parent->historyContext, node->actionFromParent.Type, reward);
 			node->currVisits.fetch_add(1);
 			atomic_add(node->currValue, reward);
 			node->virtualLoss.fetch_sub(1);
@@ -1,40 +1,111 @@
 #pragma once
 
 #include "Types.h"
+#include "DistanceField.h"
+#include "RegionMap.h"
 #include <array>
 #include <optional>
 
+// Immutable, reference-counted set of planned trajectories. Published once per step and
+// shared by every worker thread, so rollouts never copy or mutate it.
+template <int N_AGENTS>
+using FTrajectorySet = std::array<HYSTERIA_VECTOR<FAgentAction>, N_AGENTS>;
+
+// Per-rollout mutable data. Each worker owns its own scratch and passes it by reference.
+template <int N_AGENTS>
+struct FSimulationScratch
+{
+	std::array<bool, N_AGENTS> AgentIsWaitingTemporarily = {};
+
+	void Reset()
+	{
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			AgentIsWaitingTemporarily[i] = false;
+		}
+	}
+
+	void SetAgentWaitingTemporarily(int AgentIdx, bool bWaiting)
+	{
+		if (AgentIdx >= 0 && AgentIdx < N_AGENTS)
+			AgentIsWaitingTemporarily[AgentIdx] = bWaiting;
+	}
+};
+
 template <int W, int H, int N_AGENTS>
 struct FSimulationContext
 {
-	std::array<HYSTERIA_VECTOR<FAgentAction>, N_AGENTS>* AgentTrajectories = nullptr;
+	HYSTERIA_SHARED_PTR<const FTrajectorySet<N_AGENTS>> AgentTrajectories;
+	// Turn at which every trajectory in AgentTrajectories starts
 	uint8_t GlobalTurn = 0;
-	std::array<bool, N_AGENTS> AgentIsWaitingTemporarily = {};
+	// Distance fields of the searched root state, read-only for rollouts and evaluators
+	HYSTERIA_SHARED_PTR<const FDistanceFieldCache<W, H>> DistanceFields;
+	// Region abstraction of the root state; unset unless the planner plans over regions
+	HYSTERIA_SHARED_PTR<const FRegionMap<W, H>> Regions;
+
+	void PublishDistanceFields(const FDistanceFieldCache<W, H>& Fields)
+	{
+		DistanceFields = HYSTERIA_MAKE_SHARED<FDistanceFieldCache<W, H>>(Fields);
+	}
 
-	explicit FSimulationContext()
+	void PublishRegions(const FRegionMap<W, H>& InRegions)
 	{
-		AgentTrajectories = new std::array<HYSTERIA_VECTOR<FAgentAction>, N_AGENTS>();
+		Regions = HYSTERIA_MAKE_SHARED<FRegionMap<W, H>>(InRegions);
+	}
+
+	const FDistanceFieldCache<W, H>* GetDistanceFields() const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return DistanceFields.Get();
+#else
+		return DistanceFields.get();
+#endif
+	}
+
+	const FRegionMap<W, H>* GetRegions() const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return Regions.Get();
+#else
+		return Regions.get();
+#endif
+	}
+
+	// Replaces all trajectories at once with a new snapshot starting at RootTurn
+	void PublishTrajectories(FTrajectorySet<N_AGENTS>&& Trajectories, uint8_t RootTurn)
+	{
+		AgentTrajectories = HYSTERIA_MAKE_SHARED<FTrajectorySet<N_AGENTS>>(std::move(Trajectories));
+		GlobalTurn = RootTurn;
 	}
 
 	void SetTrajectory(int AgentIdx, const HYSTERIA_VECTOR<FAgentAction>& Trajectory)
 	{
-		// Sets the trajectory for the given agent.
+		// Copy-on-write: workers still holding the old snapshot keep seeing it unchanged
 		if (AgentIdx >= 0 && AgentIdx < N_AGENTS)
 		{
-			if (!AgentTrajectories)
-			{
-				AgentTrajectories = new std::array<HYSTERIA_VECTOR<FAgentAction>, N_AGENTS>();
-			}
-			(*AgentTrajectories)[AgentIdx] = Trajectory;
+			FTrajectorySet<N_AGENTS> trajectories = AgentTrajectories ? *AgentTrajectories : FTrajectorySet<N_AGENTS>();
+			trajectories[AgentIdx] = Trajectory;
+			AgentTrajectories = HYSTERIA_MAKE_SHARED<FTrajectorySet<N_AGENTS>>(std::move(trajectories));
 		}
 	}
 
-	FAgentAction GetPlannedActionForAgent(int AgentIdx, int TurnIndex)
+	bool HasTrajectory(int AgentIdx) const
+	{
+		if (!AgentTrajectories || AgentIdx < 0 || AgentIdx >= N_AGENTS)
+			return false;
+#ifdef HYSTERIA_USE_UNREAL
+		return (*AgentTrajectories)[AgentIdx].Num() > 0;
+#else
+		return !(*AgentTrajectories)[AgentIdx].empty();
+#endif
+	}
+
+	FAgentAction GetPlannedActionForAgent(int AgentIdx, int TurnIndex, const FSimulationScratch<N_AGENTS>& Scratch) const
 	{
 		if (!AgentTrajectories || AgentIdx < 0 || AgentIdx >= N_AGENTS)
 			return FAgentAction(EActionType::Wait);
 
-		if (AgentIsWaitingTemporarily[AgentIdx])
+		if (Scratch.AgentIsWaitingTemporarily[AgentIdx])
 			return FAgentAction(EActionType::Wait);
 
 		const HYSTERIA_VECTOR<FAgentAction>& traj = (*AgentTrajectories)[AgentIdx];
@@ -42,23 +113,9 @@ struct FSimulationContext
 #ifdef HYSTERIA_USE_UNREAL
 		if (offset >= 0 && offset < traj.Num())
 #else
-		if (offset >= 0 && offset < traj.size())
+		if (offset >= 0 && offset < static_cast<int>(traj.size()))
 #endif
 			return traj[offset];
 		return FAgentAction(EActionType::Wait);
 	}
-
-	void ResetTemporaryData()
-	{
-		for (int i = 0; i < N_AGENTS; ++i)
-		{
-			AgentIsWaitingTemporarily[i] = false;
-		}
-	}
-
-	void SetAgentWaitingTemporarily(int AgentIdx, bool bWaiting)
-	{
-		if (AgentIdx >= 0 && AgentIdx < N_AGENTS)
-			AgentIsWaitingTemporarily[AgentIdx] = bWaiting;
-	}
 };
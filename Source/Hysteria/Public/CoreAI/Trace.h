@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Types.h"
+
+// Timeline tracing of planner phases. HYSTERIA_TRACE_SCOPE("Name") records the enclosing scope
+// as one event; names must be string literals. Unreal builds send the events to the engine's
+// CPU profiler trace (Unreal Insights). Headless builds record them only when compiled with
+// HYSTERIA_TRACE=1, into per-thread ring buffers that HysteriaTrace::FRecorder exports as
+// Chrome/Perfetto trace JSON; otherwise the macro compiles to nothing.
+// HYSTERIA_TRACE_ROLLOUT_SCOPE marks the phases of a single rollout. Rollouts take a few
+// microseconds, so those events cost more and are only recorded with HYSTERIA_TRACE=2.
+#ifndef HYSTERIA_TRACE
+#define HYSTERIA_TRACE 0
+#endif
+
+#define HYSTERIA_TRACE_CONCAT_INNER(A, B) A##B
+#define HYSTERIA_TRACE_CONCAT(A, B) HYSTERIA_TRACE_CONCAT_INNER(A, B)
+
+#if defined(HYSTERIA_USE_UNREAL)
+
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#define HYSTERIA_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_STR(Name)
+
+#elif HYSTERIA_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace HysteriaTrace
+{
+	struct FEvent
+	{
+		const char* Name;
+		int64_t StartNs;
+		int64_t EndNs;
+	};
+
+	inline int64_t NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Ring of the latest Capacity events of one thread. Only the owning thread writes, with
+	// plain stores and a release of the head; nothing is locked on the recording path.
+	class FThreadBuffer
+	{
+	public:
+		static constexpr uint64_t Capacity = 1 << 14;
+
+		explicit FThreadBuffer(int InLane)
+			: Lane(InLane), Events(new FEvent[Capacity])
+		{
+		}
+
+		void Add(const char* Name, int64_t StartNs, int64_t EndNs)
+		{
+			const uint64_t head = Head.load(std::memory_order_relaxed);
+			Events[head & (Capacity - 1)] = FEvent{Name, StartNs, EndNs};
+			Head.store(head + 1, std::memory_order_release);
+		}
+
+		// Timeline row of the buffer; a buffer outlives its thread and is handed to the next one
+		const int Lane;
+
+	private:
+		friend class FRecorder;
+
+		std::unique_ptr<FEvent[]> Events;
+		std::atomic<uint64_t> Head{0};
+		// Events before this index were cleared
+		uint64_t Tail = 0;
+	};
+
+	// Owns every thread buffer. Threads come and go with each search, so a finished thread's
+	// buffer goes to the next thread that traces, and memory stays bounded by the peak thread
+	// count. Export and Clear only while no traced code runs.
+	class FRecorder
+	{
+	public:
+		static FRecorder& Get()
+		{
+			static FRecorder Instance;
+			return Instance;
+		}
+
+		FThreadBuffer* Acquire()
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			if (!Free.empty())
+			{
+				FThreadBuffer* buffer = Free.back();
+				Free.pop_back();
+				return buffer;
+			}
+			Buffers.push_back(std::make_unique<FThreadBuffer>(static_cast<int>(Buffers.size())));
+			return Buffers.back().get();
+		}
+
+		void Release(FThreadBuffer* Buffer)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Free.push_back(Buffer);
+		}
+
+		void Clear()
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			for (const auto& buffer : Buffers)
+				buffer->Tail = buffer->Head.load(std::memory_order_acquire);
+		}
+
+		// Trace Event Format, loadable in chrome://tracing and ui.perfetto.dev
+		std::string ToChromeJson()
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			int64_t base = INT64_MAX;
+			ForEachEvent([&base](const FThreadBuffer&, const FEvent& Event)
+			{
+				base = Event.StartNs < base ? Event.StartNs : base;
+			});
+
+			std::string json = "{\"traceEvents\":[";
+			bool bFirst = true;
+			char line[256];
+			for (const auto& buffer : Buffers)
+			{
+				std::snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+				              bFirst ? "" : ",\n", buffer->Lane, buffer->Lane);
+				json += line;
+				bFirst = false;
+			}
+			ForEachEvent([&](const FThreadBuffer& Buffer, const FEvent& Event)
+			{
+				std::snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				              Event.Name, Buffer.Lane, (Event.StartNs - base) / 1000.0, (Event.EndNs - Event.StartNs) / 1000.0);
+				json += line;
+			});
+			json += "]}\n";
+			return json;
+		}
+
+		bool WriteChromeTrace(const std::string& Path)
+		{
+			const std::string json = ToChromeJson();
+			FILE* file = std::fopen(Path.c_str(), "wb");
+			if (!file) return false;
+			const bool bWritten = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+			return std::fclose(file) == 0 && bWritten;
+		}
+
+	private:
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<FThreadBuffer>> Buffers;
+		std::vector<FThreadBuffer*> Free;
+
+		// The events still in the rings, oldest first per buffer
+		template <typename TVisitor>
+		void ForEachEvent(TVisitor&& Visit) const
+		{
+			for (const auto& buffer : Buffers)
+			{
+				const uint64_t head = buffer->Head.load(std::memory_order_acquire);
+				uint64_t first = head > FThreadBuffer::Capacity ? head - FThreadBuffer::Capacity : 0;
+				first = buffer->Tail > first ? buffer->Tail : first;
+				for (uint64_t i = first; i < head; ++i)
+					Visit(*buffer, buffer->Events[i & (FThreadBuffer::Capacity - 1)]);
+			}
+		}
+	};
+
+	// Takes a buffer on the thread's first event and gives it back when the thread exits
+	struct FThreadSlot
+	{
+		FThreadBuffer* Buffer = nullptr;
+
+		~FThreadSlot()
+		{
+			if (Buffer)
+				FRecorder::Get().Release(Buffer);
+		}
+	};
+
+	inline FThreadBuffer& GetThreadBuffer()
+	{
+		thread_local FThreadSlot Slot;
+		if (!Slot.Buffer)
+			Slot.Buffer = FRecorder::Get().Acquire();
+		return *Slot.Buffer;
+	}
+
+	class FScope
+	{
+	public:
+		explicit FScope(const char* InName)
+			: Name(InName), StartNs(NowNs())
+		{
+		}
+
+		~FScope()
+		{
+			GetThreadBuffer().Add(Name, StartNs, NowNs());
+		}
+
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+
+	private:
+		const char* Name;
+		int64_t StartNs;
+	};
+}
+
+#define HYSTERIA_TRACE_SCOPE(Name) HysteriaTrace::FScope HYSTERIA_TRACE_CONCAT(HysteriaTraceScope_, __LINE__)(Name)
+
+#else
+
+#define HYSTERIA_TRACE_SCOPE(Name) ((void)0)
+
+#endif
+
+#if HYSTERIA_TRACE >= 2
+#define HYSTERIA_TRACE_ROLLOUT_SCOPE(Name) HYSTERIA_TRACE_SCOPE(Name)
+#else
+#define HYSTERIA_TRACE_ROLLOUT_SCOPE(Name) ((void)0)
+#endif
@@ -5,23 +5,38 @@
 	#include "Containers/UnrealString.h"
 	#include "Misc/Optional.h"
 	#include "Templates/SharedPointer.h"
+	#include "HAL/PlatformTime.h"
 	#define HYSTERIA_VECTOR      TArray
 	#define HYSTERIA_MAP         TMap
 	#define HYSTERIA_OPTIONAL    TOptional
 	#define HYSTERIA_STRING      FString
 	#define HYSTERIA_SHARED_PTR  TSharedPtr
+	#define HYSTERIA_MAKE_SHARED MakeShared
 #else
 	#include <vector>
 	#include <map>
 	#include <optional>
 	#include <string>
 	#include <memory>
+	#include <chrono>
 	#define HYSTERIA_VECTOR      std::vector
 	#define HYSTERIA_MAP         std::map
 	#define HYSTERIA_OPTIONAL    std::optional
 	#define HYSTERIA_STRING      std::string
 	#define HYSTERIA_SHARED_PTR  std::shared_ptr
+	#define HYSTERIA_MAKE_SHARED std::make_shared
 #endif
+
+// Monotonic wall clock in seconds, used for search budgets and stats
+inline double HysteriaNowSeconds()
+{
+#ifdef HYSTERIA_USE_UNREAL
+	return FPlatformTime::Seconds();
+#else
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 enum class CellType : uint8_t
 {
 	Empty,
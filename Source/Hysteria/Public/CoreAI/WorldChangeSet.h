@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Types.h"
+#include <cstdint>
+
+// New contents of a cell that was written
+struct FCellChange
+{
+	uint8_t X = 0;
+	uint8_t Y = 0;
+	CellType Tile = CellType::Empty;
+	ItemType Item = ItemType::None;
+};
+
+// New state of an agent that moved or whose item or score changed
+struct FAgentChange
+{
+	int Agent = 0;
+	AgentState State = {};
+};
+
+// What changed in a world between two points, e.g. one step or one batch of edits, so a view
+// can update only those cells and agents. Collected from WorldState's dirty tracking, which
+// may list a cell that was written back to its old contents, or computed exactly by
+// WorldState::DiffTo.
+struct FWorldChangeSet
+{
+	HYSTERIA_VECTOR<FCellChange> Cells;
+	HYSTERIA_VECTOR<FAgentChange> Agents;
+
+	bool IsEmpty() const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		return Cells.Num() == 0 && Agents.Num() == 0;
+#else
+		return Cells.empty() && Agents.empty();
+#endif
+	}
+
+	void Reset()
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		Cells.Reset();
+		Agents.Reset();
+#else
+		Cells.clear();
+		Agents.clear();
+#endif
+	}
+
+	void AddCell(int X, int Y, CellType Tile, ItemType Item)
+	{
+		FCellChange change;
+		change.X = static_cast<uint8_t>(X);
+		change.Y = static_cast<uint8_t>(Y);
+		change.Tile = Tile;
+		change.Item = Item;
+#ifdef HYSTERIA_USE_UNREAL
+		Cells.Add(change);
+#else
+		Cells.push_back(change);
+#endif
+	}
+
+	void AddAgent(int Agent, const AgentState& State)
+	{
+		FAgentChange change;
+		change.Agent = Agent;
+		change.State = State;
+#ifdef HYSTERIA_USE_UNREAL
+		Agents.Add(change);
+#else
+		Agents.push_back(change);
+#endif
+	}
+};
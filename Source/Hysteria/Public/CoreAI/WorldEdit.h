@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include <atomic>
+#include <cstdint>
+
+enum class EWorldEditType : uint8_t
+{
+	SetTile,
+	SetItem,
+	MoveAgent
+};
+
+// One change to the world from outside the simulation, e.g. an editor tool. The planner takes
+// edits through FMultiAgentMCTS::ApplyWorldEdits so it can tell which searches they affect.
+struct FWorldEdit
+{
+	EWorldEditType Type = EWorldEditType::SetTile;
+	uint8_t X = 0;
+	uint8_t Y = 0;
+	CellType Tile = CellType::Empty;
+	ItemType Item = ItemType::None;
+	uint8_t Agent = 0;
+
+	static FWorldEdit SetTile(int X, int Y, CellType Tile)
+	{
+		FWorldEdit edit;
+		edit.Type = EWorldEditType::SetTile;
+		edit.X = static_cast<uint8_t>(X);
+		edit.Y = static_cast<uint8_t>(Y);
+		edit.Tile = Tile;
+		return edit;
+	}
+
+	static FWorldEdit SetItem(int X, int Y, ItemType Item)
+	{
+		FWorldEdit edit;
+		edit.Type = EWorldEditType::SetItem;
+		edit.X = static_cast<uint8_t>(X);
+		edit.Y = static_cast<uint8_t>(Y);
+		edit.Item = Item;
+		return edit;
+	}
+
+	// Places Agent on X, Y
+	static FWorldEdit MoveAgent(int Agent, int X, int Y)
+	{
+		FWorldEdit edit;
+		edit.Type = EWorldEditType::MoveAgent;
+		edit.Agent = static_cast<uint8_t>(Agent);
+		edit.X = static_cast<uint8_t>(X);
+		edit.Y = static_cast<uint8_t>(Y);
+		return edit;
+	}
+
+	// Edits with the same key overwrite each other: one per cell and layer, one per agent move
+	uint32_t GetCoalesceKey() const
+	{
+		const uint32_t target = Type == EWorldEditType::MoveAgent ? Agent : (static_cast<uint32_t>(Y) << 8 | X);
+		return static_cast<uint32_t>(Type) << 16 | target;
+	}
+
+	template <int W, int H, int N_AGENTS>
+	void ApplyTo(WorldState<W, H, N_AGENTS>& State) const
+	{
+		switch (Type)
+		{
+		case EWorldEditType::SetTile:
+			State.SetTile(X, Y, Tile);
+			break;
+		case EWorldEditType::SetItem:
+			State.SetItem(X, Y, Item);
+			break;
+		case EWorldEditType::MoveAgent:
+			if (Agent < N_AGENTS && X < W && Y < H)
+			{
+				State.agents[Agent].x = X;
+				State.agents[Agent].y = Y;
+				State.MarkAgentChanged(Agent);
+			}
+			break;
+		}
+	}
+};
+
+// Lock-free multi-producer, single-consumer queue of world edits. Any thread may Push; only
+// the planner drains, at points where no search reads the world. Producers push onto an
+// atomic list head, the consumer takes the whole list in one exchange, so there is no ABA.
+class FWorldEditQueue
+{
+public:
+	FWorldEditQueue() = default;
+	FWorldEditQueue(const FWorldEditQueue&) = delete;
+	FWorldEditQueue& operator=(const FWorldEditQueue&) = delete;
+
+	~FWorldEditQueue()
+	{
+		FreeList(Head.exchange(nullptr));
+	}
+
+	void Push(const FWorldEdit& Edit)
+	{
+		FNode* node = new FNode{Edit, Head.load(std::memory_order_relaxed)};
+		while (!Head.compare_exchange_weak(node->Next, node, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	bool IsEmpty() const
+	{
+		return Head.load(std::memory_order_acquire) == nullptr;
+	}
+
+	// Consumer only. Appends the queued edits to OutEdits in push order, keeping only the last
+	// edit per coalesce key, so a burst of clicks on one cell becomes one edit. Returns how
+	// many edits were pushed.
+	int Drain(HYSTERIA_VECTOR<FWorldEdit>& OutEdits)
+	{
+		FNode* list = Head.exchange(nullptr, std::memory_order_acquire);
+
+		// The list is newest first: keep an edit unless a newer one has its key
+		HYSTERIA_VECTOR<FWorldEdit> newestFirst;
+		HYSTERIA_MAP<uint32_t, bool> seen;
+		int pushed = 0;
+		for (FNode* node = list; node; node = node->Next)
+		{
+			++pushed;
+			const uint32_t key = node->Edit.GetCoalesceKey();
+#ifdef HYSTERIA_USE_UNREAL
+			if (seen.Contains(key)) continue;
+			seen.Add(key, true);
+			newestFirst.Add(node->Edit);
+#else
+			if (!seen.emplace(key, true).second) continue;
+			newestFirst.push_back(node->Edit);
+#endif
+		}
+		FreeList(list);
+
+#ifdef HYSTERIA_USE_UNREAL
+		for (int32 i = newestFirst.Num() - 1; i >= 0; --i)
+			OutEdits.Add(newestFirst[i]);
+#else
+		OutEdits.insert(OutEdits.end(), newestFirst.rbegin(), newestFirst.rend());
+#endif
+		return pushed;
+	}
+
+private:
+	struct FNode
+	{
+		FWorldEdit Edit;
+		FNode* Next;
+	};
+
+	std::atomic<FNode*> Head{nullptr};
+
+	static void FreeList(FNode* Node)
+	{
+		while (Node)
+		{
+			FNode* next = Node->Next;
+			delete Node;
+			Node = next;
+		}
+	}
+};
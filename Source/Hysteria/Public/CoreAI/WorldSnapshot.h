@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Types.h"
+#include "WorldState.h"
+#include <cstdint>
+#ifdef HYSTERIA_USE_UNREAL
+#include "HAL/CriticalSection.h"
+#include "Misc/ScopeLock.h"
+#else
+#include <atomic>
+#include <memory>
+#endif
+
+// An immutable copy of the world as the planner last published it. Version grows by one with
+// every publish, so a reader can tell whether anything changed since its last look. Changes
+// lead from Version - 1 to this one; a reader that skipped versions diffs instead.
+template <int W, int H, int N_AGENTS>
+struct FWorldSnapshot
+{
+	WorldState<W, H, N_AGENTS> State;
+	uint64_t Version = 0;
+	FWorldChangeSet Changes;
+};
+
+// Single writer, any number of readers. The writer builds a new snapshot and swaps the shared
+// pointer; readers take a reference to the current one and scan it as long as they like, while
+// the writer moves on. A snapshot is freed once its last reader lets go of it.
+template <int W, int H, int N_AGENTS>
+class FWorldSnapshotPublisher
+{
+public:
+	using FSnapshot = FWorldSnapshot<W, H, N_AGENTS>;
+	using FSnapshotPtr = HYSTERIA_SHARED_PTR<const FSnapshot>;
+
+	// Writer only
+	void Publish(const WorldState<W, H, N_AGENTS>& State, FWorldChangeSet&& Changes)
+	{
+		HYSTERIA_SHARED_PTR<FSnapshot> Snapshot = HYSTERIA_MAKE_SHARED<FSnapshot>();
+		Snapshot->State = State;
+		Snapshot->Version = ++LastVersion;
+		Snapshot->Changes = std::move(Changes);
+#ifdef HYSTERIA_USE_UNREAL
+		FSnapshotPtr Old;
+		{
+			// Held for a pointer swap only; the old snapshot is released outside the lock
+			FScopeLock Lock(&SwapLock);
+			Old = MoveTemp(Current);
+			Current = Snapshot;
+		}
+#else
+		std::atomic_store_explicit(&Current, FSnapshotPtr(std::move(Snapshot)), std::memory_order_release);
+#endif
+	}
+
+	// Any thread; null before the first Publish
+	FSnapshotPtr Get() const
+	{
+#ifdef HYSTERIA_USE_UNREAL
+		FScopeLock Lock(&SwapLock);
+		return Current;
+#else
+		return std::atomic_load_explicit(&Current, std::memory_order_acquire);
+#endif
+	}
+
+	// Writer only
+	uint64_t GetLastVersion() const
+	{
+		return LastVersion;
+	}
+
+private:
+	FSnapshotPtr Current;
+	uint64_t LastVersion = 0;
+#ifdef HYSTERIA_USE_UNREAL
+	mutable FCriticalSection SwapLock;
+#endif
+};
@@ -1,33 +1,34 @@
 #pragma once
 #include "Types.h"
 #include "SimulationContext.h"
+#include "MoveTable.h"
+#include "BinaryArchive.h"
+#include "WorldChangeSet.h"
+#include <cstring>
 
 
 template <int W, int H, int N_AGENTS>
 struct WorldState
 {
+	using FMoves = FMoveTable<W, H>;
+
 	CellType grid[H][W];
 	ItemType items[H][W];
 	AgentState agents[N_AGENTS];
 	uint8_t turnCounter;
 	EDirection Directions[4] = { EDirection::Up, EDirection::Down, EDirection::Left, EDirection::Right };
+	// Bit m is set if move m (see FMoveTable) from this cell lands on an empty cell.
+	// Follows SetTile/SetNeighborTileCell; call RebuildMoveTables after writing grid directly.
+	uint8_t MoveMask[H][W];
+	// Cells and agents written since the last ClearChanges, one bit each (see GetChanges)
+	uint64_t DirtyCells[(W * H + 63) / 64] = {};
+	uint64_t DirtyAgents[(N_AGENTS + 63) / 64] = {};
 
-	WorldState Clone()
+	// Copy with no recorded changes, so a rollout's change bits are exactly its own writes
+	WorldState Clone() const
 	{
-		WorldState<W, H, N_AGENTS> newState;
-		for (int y = 0; y < H; ++y)
-		{
-			for (int x = 0; x < W; ++x)
-			{
-				newState.grid[y][x] = grid[y][x];
-				newState.items[y][x] = items[y][x];
-			}
-		}
-		for (int i = 0; i < N_AGENTS; ++i)
-		{
-			newState.agents[i] = agents[i];
-		}
-		newState.turnCounter = turnCounter;
+		WorldState<W, H, N_AGENTS> newState(*this);
+		newState.ClearChanges();
 		return newState;
 	}
 
@@ -45,6 +46,202 @@ struct WorldState
 				items[y][x] = ItemType::None;
 
 		turnCounter = 0;
+		RebuildMoveTables();
+	}
+
+	void RebuildMoveTables()
+	{
+		for (int y = 0; y < H; ++y)
+			for (int x = 0; x < W; ++x)
+				UpdateMoveMask(x, y);
+	}
+
+	// The tile of (x, y) changed, so the moves of its neighbours into it did too
+	void InvalidateMoves(int x, int y)
+	{
+		const int cell = y * W + x;
+		for (int m = 0; m < FMoves::NumMoves; ++m)
+		{
+			const int neighbor = FMoves::GetNeighbor(cell, m);
+			if (neighbor != FMoves::NoCell)
+				UpdateMoveMask(neighbor % W, neighbor / W);
+		}
+	}
+
+	// 64-bit hash of tiles, items and agents, mixed a word at a time since search hashes every
+	// leaf. The turn counter is left out, so the same position reached at another turn hashes
+	// the same.
+	uint64_t Hash() const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto Mix = [&hash](const void* Data, size_t Size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(Data);
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= Size; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				std::memcpy(&word, bytes + i, sizeof(word));
+				hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+				hash ^= hash >> 29;
+			}
+			for (; i < Size; ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		};
+		Mix(grid, sizeof(grid));
+		Mix(items, sizeof(items));
+		for (const AgentState& agent : agents)
+		{
+			Mix(&agent.x, sizeof(agent.x));
+			Mix(&agent.y, sizeof(agent.y));
+			Mix(&agent.hasItem, sizeof(agent.hasItem));
+			Mix(&agent.item, sizeof(agent.item));
+			Mix(&agent.score, sizeof(agent.score));
+			Mix(&agent.isPanicking, sizeof(agent.isPanicking));
+		}
+		return hash;
+	}
+
+	void Save(FBinaryWriter& Writer) const
+	{
+		Writer.WriteBytes(grid, sizeof(grid));
+		Writer.WriteBytes(items, sizeof(items));
+		for (const AgentState& agent : agents)
+		{
+			Writer.Write(agent.x);
+			Writer.Write(agent.y);
+			Writer.Write(agent.hasItem);
+			Writer.Write(agent.item);
+			Writer.Write(agent.score);
+			Writer.Write(agent.isPanicking);
+		}
+		Writer.Write(turnCounter);
+	}
+
+	// Reads a world written by Save. Derived tables are rebuilt, attached services are not notified.
+	// False on a short read or on values Save cannot have written: out-of-range tiles, items or
+	// flags, or an agent off the map. The world is left half-read then and must not be used.
+	bool Load(FBinaryReader& Reader)
+	{
+		uint8_t rawGrid[H][W];
+		uint8_t rawItems[H][W];
+		if (!Reader.ReadBytes(rawGrid, sizeof(rawGrid)) || !Reader.ReadBytes(rawItems, sizeof(rawItems)))
+			return false;
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				if (rawGrid[y][x] > static_cast<uint8_t>(CellType::PlayerObstacle) ||
+					rawItems[y][x] > static_cast<uint8_t>(ItemType::Coin))
+					return false;
+				grid[y][x] = static_cast<CellType>(rawGrid[y][x]);
+				items[y][x] = static_cast<ItemType>(rawItems[y][x]);
+			}
+		}
+		for (AgentState& agent : agents)
+		{
+			uint8_t hasItem = 0, item = 0, isPanicking = 0;
+			Reader.Read(agent.x);
+			Reader.Read(agent.y);
+			Reader.Read(hasItem);
+			Reader.Read(item);
+			Reader.Read(agent.score);
+			Reader.Read(isPanicking);
+			if (Reader.HasFailed() || agent.x >= W || agent.y >= H || hasItem > 1 || isPanicking > 1 ||
+				item > static_cast<uint8_t>(ItemType::Coin))
+				return false;
+			agent.hasItem = hasItem != 0;
+			agent.item = static_cast<ItemType>(item);
+			agent.isPanicking = isPanicking != 0;
+		}
+		Reader.Read(turnCounter);
+		if (Reader.HasFailed()) return false;
+		RebuildMoveTables();
+		MarkAllChanged();
+		return true;
+	}
+
+	// Called whenever the tile or item of a cell changes
+	void MarkCellChanged(int x, int y)
+	{
+		const int cell = y * W + x;
+		DirtyCells[cell >> 6] |= 1ull << (cell & 63);
+	}
+
+	// Called whenever an agent moves or its item or score changes
+	void MarkAgentChanged(int agent)
+	{
+		DirtyAgents[agent >> 6] |= 1ull << (agent & 63);
+	}
+
+	// For writes that bypass the setters, e.g. to grid directly
+	void MarkAllChanged()
+	{
+		for (int i = 0; i < W * H; ++i)
+			DirtyCells[i >> 6] |= 1ull << (i & 63);
+		for (int i = 0; i < N_AGENTS; ++i)
+			MarkAgentChanged(i);
+	}
+
+	// True if a tile or item was written since the last ClearChanges
+	bool HasCellChanges() const
+	{
+		for (uint64_t word : DirtyCells)
+			if (word) return true;
+		return false;
+	}
+
+	bool HasChanges() const
+	{
+		for (uint64_t word : DirtyCells)
+			if (word) return true;
+		for (uint64_t word : DirtyAgents)
+			if (word) return true;
+		return false;
+	}
+
+	// Appends the cells and agents written since the last ClearChanges, with their current contents
+	void GetChanges(FWorldChangeSet& Out) const
+	{
+		for (int i = 0; i < W * H; ++i)
+		{
+			if ((DirtyCells[i >> 6] >> (i & 63)) & 1)
+				Out.AddCell(i % W, i / W, grid[i / W][i % W], items[i / W][i % W]);
+		}
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			if ((DirtyAgents[i >> 6] >> (i & 63)) & 1)
+				Out.AddAgent(i, agents[i]);
+		}
+	}
+
+	void ClearChanges()
+	{
+		for (uint64_t& word : DirtyCells)
+			word = 0;
+		for (uint64_t& word : DirtyAgents)
+			word = 0;
+	}
+
+	// Appends the exact differences from this world to Other, e.g. between two snapshots
+	void DiffTo(const WorldState& Other, FWorldChangeSet& Out) const
+	{
+		for (int y = 0; y < H; ++y)
+		{
+			for (int x = 0; x < W; ++x)
+			{
+				if (grid[y][x] != Other.grid[y][x] || items[y][x] != Other.items[y][x])
+					Out.AddCell(x, y, Other.grid[y][x], Other.items[y][x]);
+			}
+		}
+		for (int i = 0; i < N_AGENTS; ++i)
+		{
+			const AgentState& a = agents[i];
+			const AgentState& b = Other.agents[i];
+			if (a.x != b.x || a.y != b.y || a.hasItem != b.hasItem || a.item != b.item ||
+				a.score != b.score || a.isPanicking != b.isPanicking)
+				Out.AddAgent(i, b);
+		}
 	}
 
 	int GetAgentCount() const
@@ -64,24 +261,11 @@ struct WorldState
 
 	bool CanExecute(int agent, const FAgentAction& action)
 	{
+		if (FMoves::IsMove(action.Type))
+			return (MoveMask[agents[agent].y][agents[agent].x] >> static_cast<int>(action.Type)) & 1;
+
 		switch (action.Type)
 		{
-		case EActionType::MoveUp:
-			if (agents[agent].y > 0 && grid[agents[agent].y - 1][agents[agent].x] == CellType::Empty)
-				return true;
-			return false;
-		case EActionType::MoveDown:
-			if (agents[agent].y < H - 1 && grid[agents[agent].y + 1][agents[agent].x] == CellType::Empty)
-				return true;
-			return false;
-		case EActionType::MoveLeft:
-			if (agents[agent].x > 0 && grid[agents[agent].y][agents[agent].x - 1] == CellType::Empty)
-				return true;
-			return false;
-		case EActionType::MoveRight:
-			if (agents[agent].x < W - 1 && grid[agents[agent].y][agents[agent].x + 1] == CellType::Empty)
-				return true;
-			return false;
 		case EActionType::Pickup:
 			if (items[agents[agent].y][agents[agent].x] != ItemType::None)
 				return true;
@@ -122,7 +306,8 @@ struct WorldState
 		}
 	}
 
-	void AgentTurnOverride(FSimulationContext<W, H, N_AGENTS> SimulationContext, int agentNr,
+	void AgentTurnOverride(const FSimulationContext<W, H, N_AGENTS>& SimulationContext,
+	                       FSimulationScratch<N_AGENTS>& Scratch, int agentNr,
 	                       const FAgentAction& action, bool increaseTurn = true)
 	{
 		//Iterate over all agents and apply the action. For agentNr, we choose action, for the others we get it from the simulation context.
@@ -134,14 +319,17 @@ struct WorldState
 			}
 			else
 			{
-				const auto& step = SimulationContext.GetPlannedActionForAgent(i, turnCounter);
+				const auto step = SimulationContext.GetPlannedActionForAgent(i, turnCounter, Scratch);
 				if (!CanExecute(i, step))
 				{
 					//We cant execute the action, so we wait. Mark the agent as waiting temporarily.
-					SimulationContext.SetAgentWaitingTemporarily(i, true);
+					Scratch.SetAgentWaitingTemporarily(i, true);
 					ApplyAgentAction(i, FAgentAction{EActionType::Wait});
 				}
-				ApplyAgentAction(i, step);
+				else
+				{
+					ApplyAgentAction(i, step);
+				}
 			}
 		}
 
@@ -158,6 +346,7 @@ struct WorldState
 		if (x >= 0 && x < W && y >= 0 && y < H)
 		{
 			items[y][x] = item;
+			MarkCellChanged(x, y);
 		}
 	}
 
@@ -167,50 +356,39 @@ struct WorldState
 		if (x >= 0 && x < W && y >= 0 && y < H)
 		{
 			grid[y][x] = type;
+			InvalidateMoves(x, y);
+			MarkCellChanged(x, y);
 		}
 	}
 
 	void HandleNeighborTileOnUseItem(int Agent, CellType CType)
 	{
-		for (int i = 0; i < sizeof(Directions); i++)
+		for (EDirection direction : Directions)
 		{
-			auto direction = Directions[i];
 			if (GetNeighborTileCell(agents[Agent].x, agents[Agent].y, direction) == CType)
 			{
 				SetNeighborTileCell(agents[Agent].x, agents[Agent].y, direction, CellType::Empty);
 				agents[Agent].score += 10;
+				MarkAgentChanged(Agent);
 			}
 		}
 	}
 
 	void ApplyAgentAction(int agent, const FAgentAction& action)
 	{
+		if (FMoves::IsMove(action.Type))
+		{
+			// Blocked moves multiply the step by zero instead of branching
+			const int move = static_cast<int>(action.Type);
+			const int legal = (MoveMask[agents[agent].y][agents[agent].x] >> move) & 1;
+			agents[agent].x = static_cast<uint8_t>(agents[agent].x + legal * FMoves::MoveDX[move]);
+			agents[agent].y = static_cast<uint8_t>(agents[agent].y + legal * FMoves::MoveDY[move]);
+			DirtyAgents[agent >> 6] |= static_cast<uint64_t>(legal) << (agent & 63);
+			return;
+		}
+
 		switch (action.Type)
 		{
-		case EActionType::MoveUp:
-			if (agents[agent].y > 0 && grid[agents[agent].y - 1][agents[agent].x] == CellType::Empty)
-			{
-				agents[agent].y--;
-			}
-			break;
-		case EActionType::MoveDown:
-			if (agents[agent].y < H - 1 && grid[agents[agent].y + 1][agents[agent].x] == CellType::Empty)
-			{
-				agents[agent].y++;
-			}
-			break;
-		case EActionType::MoveLeft:
-			if (agents[agent].x > 0 && grid[agents[agent].y][agents[agent].x - 1] == CellType::Empty)
-			{
-				agents[agent].x--;
-			}
-			break;
-		case EActionType::MoveRight:
-			if (agents[agent].x < W - 1 && grid[agents[agent].y][agents[agent].x + 1] == CellType::Empty)
-			{
-				agents[agent].x++;
-			}
-			break;
 		case EActionType::Pickup:
 			if (items[agents[agent].y][agents[agent].x] != ItemType::None)
 			{
@@ -218,6 +396,8 @@ struct WorldState
 				{
 					agents[agent].score += 10;
 					items[agents[agent].y][agents[agent].x] = ItemType::None;
+					MarkCellChanged(agents[agent].x, agents[agent].y);
+					MarkAgentChanged(agent);
 				}
 				else
 				{
@@ -225,6 +405,8 @@ struct WorldState
 					agents[agent].item = items[agents[agent].y][agents[agent].x];
 					items[agents[agent].y][agents[agent].x] = previousItem;
 					agents[agent].hasItem = true;
+					MarkCellChanged(agents[agent].x, agents[agent].y);
+					MarkAgentChanged(agent);
 				}
 			}
 			break;
@@ -234,6 +416,8 @@ struct WorldState
 				items[agents[agent].y][agents[agent].x] = agents[agent].item;
 				agents[agent].hasItem = false;
 				agents[agent].item = ItemType::None;
+				MarkCellChanged(agents[agent].x, agents[agent].y);
+				MarkAgentChanged(agent);
 			}
 			break;
 		case EActionType::UseItem:
@@ -258,144 +442,85 @@ struct WorldState
 
 	ItemType GetNeighborTileItem(int X, int Y, EDirection Direction)
 	{
-		switch (Direction)
-		{
-		case EDirection::Down:
-			Y = Y + 1;
-			break;
-		case EDirection::Up:
-			Y = Y - 1;
-			break;
-		case EDirection::Left:
-			X = X - 1;
-			break;
-		case EDirection::Right:
-			X = X + 1;
-			break;
-		}
-		if (X >= 0 && X < W && Y >= 0 && Y < H)
-		{
-			return items[Y][X];
-		}
-		return ItemType::None;
+		const int neighbor = FMoves::GetNeighbor(Y * W + X, FMoves::MoveIndex(Direction));
+		return neighbor != FMoves::NoCell ? (&items[0][0])[neighbor] : ItemType::None;
 	}
 
 	CellType GetNeighborTileCell(int X, int Y, EDirection Direction)
 	{
-		switch (Direction)
-		{
-		case EDirection::Down:
-			Y = Y + 1;
-			break;
-		case EDirection::Up:
-			Y = Y - 1;
-			break;
-		case EDirection::Left:
-			X = X - 1;
-			break;
-		case EDirection::Right:
-			X = X + 1;
-			break;
-		}
-		if (X >= 0 && X < W && Y >= 0 && Y < H)
-		{
-			return grid[Y][X];
-		}
-		return CellType::Empty;
+		const int neighbor = FMoves::GetNeighbor(Y * W + X, FMoves::MoveIndex(Direction));
+		return neighbor != FMoves::NoCell ? (&grid[0][0])[neighbor] : CellType::Empty;
 	}
 
 	void SetNeighborTileCell(int X, int Y, EDirection Direction, CellType Type)
 	{
-		switch (Direction)
-		{
-		case EDirection::Down:
-			Y = Y + 1;
-			break;
-		case EDirection::Up:
-			Y = Y - 1;
-			break;
-		case EDirection::Left:
-			X = X - 1;
-			break;
-		case EDirection::Right:
-			X = X + 1;
-			break;
-		}
-		if (X >= 0 && X < W && Y >= 0 && Y < H)
+		const int neighbor = FMoves::GetNeighbor(Y * W + X, FMoves::MoveIndex(Direction));
+		if (neighbor != FMoves::NoCell)
 		{
-			grid[Y][X] = Type;
+			(&grid[0][0])[neighbor] = Type;
+			InvalidateMoves(neighbor % W, neighbor / W);
+			MarkCellChanged(neighbor % W, neighbor / W);
 		}
 	}
 
-	HYSTERIA_VECTOR<FAgentAction> GetLegalActionsForAgent(int agent)
+	// Writes the legal actions of agent to OutActions (room for every EActionType) and returns
+	// how many there are; allocation-free variant for the search
+	int GetLegalActionsForAgent(int agent, FAgentAction* OutActions)
 	{
-		HYSTERIA_VECTOR<FAgentAction> actions = {};
-		// Check if agent can move up
-		if (agents[agent].y > 0 && grid[agents[agent].y - 1][agents[agent].x] == CellType::Empty)
-		{
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::MoveUp});
-#else
-			actions.push_back({EActionType::MoveUp});
-#endif
-		}
-		// Check if agent can move down
-		if (agents[agent].y < H - 1 && grid[agents[agent].y + 1][agents[agent].x] == CellType::Empty)
+		int count = 0;
+		// Moves in the order Up, Down, Left, Right
+		static constexpr EActionType MoveOrder[] = {
+			EActionType::MoveUp, EActionType::MoveDown, EActionType::MoveLeft, EActionType::MoveRight
+		};
+		const uint8_t mask = MoveMask[agents[agent].y][agents[agent].x];
+		for (EActionType move : MoveOrder)
 		{
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::MoveDown});
-#else
-			actions.push_back({EActionType::MoveDown});
-#endif
-		}
-		// Check if agent can move left
-		if (agents[agent].x > 0 && grid[agents[agent].y][agents[agent].x - 1] == CellType::Empty)
-		{
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::MoveLeft});
-#else
-			actions.push_back({EActionType::MoveLeft});
-#endif
-		}
-		// Check if agent can move right
-		if (agents[agent].x < W - 1 && grid[agents[agent].y][agents[agent].x + 1] == CellType::Empty)
-		{
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::MoveRight});
-#else
-			actions.push_back({EActionType::MoveRight});
-#endif
+			if (mask & (1 << static_cast<int>(move)))
+				OutActions[count++] = FAgentAction(move);
 		}
 		// Check if agent can pick up an item
 		if (items[agents[agent].y][agents[agent].x] != ItemType::None && !(agents[agent].hasItem && agents[agent].item
 			== items[agents[agent].y][agents[agent].x]))
 		{
 			// Only allow pickup if agent does not already have an item or has a different item (will drop the currently held one)
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::Pickup});
-#else
-			actions.push_back({EActionType::Pickup});
-#endif
+			OutActions[count++] = FAgentAction(EActionType::Pickup);
 		}
 		// Check if agent can drop an item
 		if (agents[agent].hasItem && items[agents[agent].y][agents[agent].x] == ItemType::None)
-		{
-#ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::Drop});
-#else
-			actions.push_back({EActionType::Drop});
-#endif
-		}
+			OutActions[count++] = FAgentAction(EActionType::Drop);
 		// Check if agent can use an item
 		if (agents[agent].hasItem && CanExecute(agent, EActionType::UseItem))
+			OutActions[count++] = FAgentAction(EActionType::UseItem);
+		return count;
+	}
+
+	HYSTERIA_VECTOR<FAgentAction> GetLegalActionsForAgent(int agent)
+	{
+		FAgentAction legal[static_cast<int>(EActionType::Wait) + 1];
+		const int count = GetLegalActionsForAgent(agent, legal);
+		HYSTERIA_VECTOR<FAgentAction> actions = {};
+		for (int i = 0; i < count; ++i)
 		{
 #ifdef HYSTERIA_USE_UNREAL
-			actions.Add({EActionType::UseItem});
+			actions.Add(legal[i]);
 #else
-			actions.push_back({EActionType::UseItem});
+			actions.push_back(legal[i]);
 #endif
 		}
-
 		return actions;
 	}
+
+private:
+	void UpdateMoveMask(int x, int y)
+	{
+		const int cell = y * W + x;
+		uint8_t mask = 0;
+		for (int m = 0; m < FMoves::NumMoves; ++m)
+		{
+			const int neighbor = FMoves::GetNeighbor(cell, m);
+			if (neighbor != FMoves::NoCell && (&grid[0][0])[neighbor] == CellType::Empty)
+				mask |= static_cast<uint8_t>(1 << m);
+		}
+		MoveMask[y][x] = mask;
+	}
 };
@@ -52,6 +52,7 @@ namespace HysteriaSim
 
 		state.turnCounter = 0;
 
+		state.RebuildMoveTables();
 		return state;
 	}
 	
@@ -75,6 +76,7 @@ namespace HysteriaSim
 
 		state.turnCounter = 0;
 
+		state.RebuildMoveTables();
 		return state;
 	}
 }
\ No newline at end of file
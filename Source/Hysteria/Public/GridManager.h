@@ -2,6 +2,7 @@
 
 #include "CoreMinimal.h"
 #include "CoreAI/FMultiAgentMCTS.h"
+#include "CoreAI/GridView.h"
 #include "CoreAI/WorldState.h"
 #include "GameFramework/Actor.h"
 #include "GridManager.generated.h"
@@ -33,10 +34,20 @@ protected:
 	void ShowWorldState();
 	FMultiAgentMCTS<16, 16, 3>* Planner = nullptr;
 	EInputAction CurrentTool;
-	TArray<AActor*> PlacedActors;
+	// Which pooled instance shows what; ViewActors holds the actor of each instance
+	FGridView<16, 16, 3> View;
+	TArray<AActor*> ViewActors;
+	TSubclassOf<AActor> GetVisualClass(EGridVisual Visual) const;
 	
-	WorldState<16, 16, 3> GetPlannerWorld() const;
+	// Latest world the planner published; cheap, and safe while it searches
+	FMultiAgentMCTS<16, 16, 3>::FWorldSnapshotPtr GetPlannerWorld() const;
+	// Version of the snapshot on screen
+	uint64 ShownWorldVersion = 0;
 	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaSeconds) override;
+
+	// A time-sliced turn is being searched over several ticks
+	bool bTurnPending = false;
 
 	void HandleToolAt(int32 X, int32 Y);
 	// Mouse click handler
@@ -60,6 +71,14 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Grid")
 	float TileSize = 100.0f;
 
+	// Search turns on the game thread in per-tick slices instead of on a planning thread
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Planning")
+	bool bTimeSlicedPlanning = false;
+
+	// Game thread time a time-sliced turn may take per tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Planning", meta = (EditCondition = "bTimeSlicedPlanning"))
+	float PlanningMillisecondsPerTick = 2.0f;
+
 	// Last clicked/selected cell
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Grid")
 	int32 SelectedX = -1;